@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+
+// Scalar type of the geometry and shading math. Define PT_USE_FLOAT (CMake
+// option BUILD_FLOAT32) for the single-precision render mode.
+#ifdef PT_USE_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
+// Renderer selected by path_tracer_iteration
+enum class RenderEngine {
+    megakernel,   // recursive ray_color per sample
+    wavefront     // staged SoA queues, see wavefront.h
+};
+
+// Scene the drivers render, see scene_cornell.h
+enum class SceneKind {
+    cornell,        // the Cornell box with its single ceiling light
+    ceiling_grid,   // the box lit by a 16x16 grid of small ceiling panels
+    cornell_mirror  // the Cornell box with a mirror for the back sphere
+};
+
+// How NEE chooses among the scene's lights, see lights.h
+enum class LightSampling {
+    power,   // alias table over emitted power
+    bvh      // light BVH: power over distance, horizon culled
+};
+
+// How paths gather light from emitters, see integrator.h
+enum class DirectLighting {
+    nee,   // light sampling only; BSDF bounces ignore emitters they hit
+    mis    // light and BSDF sampling, weighted by the power heuristic
+};
+
+// Tone curve applied after exposure, before display encoding
+enum class Tonemap {
+    clamp,      // none: values above 1 clip
+    reinhard,   // x / (1 + x)
+    aces        // Narkowicz's fit of the ACES filmic curve
+};
+
+// Transfer function of 8-bit output
+enum class DisplayEncoding {
+    gamma2,     // sqrt, what every writer has always used
+    srgb        // sRGB piecewise curve
+};
+
+struct PathTracerConfig {
+    int image_width = 400;
+    int image_height = 400;
+    int max_depth = 10;
+    int spp_per_iteration = 1;
+    int num_threads = 0;   // 0 = one per hardware thread
+    int tile_size = 32;
+    RenderEngine engine = RenderEngine::megakernel;
+    uint32_t seed = 0;     // keys the per-sample RNG streams
+    SceneKind scene = SceneKind::cornell;
+    LightSampling light_sampling = LightSampling::bvh;
+    DirectLighting direct_lighting = DirectLighting::mis;
+
+    // Adaptive sampling (off: every pixel takes spp_per_iteration samples).
+    // After adaptive_warmup uniform passes, each pixel of a tile still in
+    // flight gets a share of the budget proportional to its relMSE, at most
+    // adaptive_max_spp. A tile is retired once its mean relMSE drops below
+    // adaptive_threshold.
+    bool adaptive = false;
+    double adaptive_threshold = 1e-3;
+    int adaptive_warmup = 4;
+    int adaptive_max_spp = 16;
+
+    // Display transform of 8-bit output (.ppm and the viewer); .pfm and
+    // .raw stay linear
+    double exposure = 0.0;   // stops
+    Tonemap tonemap = Tonemap::clamp;
+    DisplayEncoding encoding = DisplayEncoding::gamma2;
+};
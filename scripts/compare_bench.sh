@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+# Compare two pathtracer_bench CSV outputs (e.g. before/after a change).
+# usage: compare_bench.sh base.csv new.csv
+# Prints CSV: benchmark,metric,base,new,ratio (ratio = new / base; for
+# ns_* metrics lower is better, for *_per_s higher is better)
+set -e
+if [ $# -ne 2 ]; then
+    echo "usage: $0 base.csv new.csv" >&2
+    exit 1
+fi
+
+echo "benchmark,metric,base,new,ratio"
+awk -F, '
+    FNR == 1 { next }
+    NR == FNR { base[$1 "," $2] = $3; next }
+    ($1 "," $2) in base {
+        b = base[$1 "," $2]
+        if (b ~ /^[-+0-9.eE]+$/ && $3 ~ /^[-+0-9.eE]+$/ && b != 0)
+            printf "%s,%s,%s,%s,%.3f\n", $1, $2, b, $3, $3 / b
+        else
+            printf "%s,%s,%s,%s,\n", $1, $2, b, $3
+    }
+' "$1" "$2"
@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+# Strong scaling of the MPI renderer: image-space (dynamic tiles) vs
+# sample-space decomposition at a fixed total sample count, 1..N ranks.
+# usage: mpi_scaling.sh [max_ranks] [passes] [threads_per_rank]
+# Prints CSV: decomp,ranks,threads,seconds,msamples_per_s
+set -e
+MAX_RANKS=${1:-8}
+PASSES=${2:-32}
+THREADS=${3:-1}
+
+mkdir -p ../build
+cd ../build
+cmake -DBUILD_MPI=ON -DBUILD_HIP=OFF -DBUILD_GUI=OFF .. > /dev/null
+make -j pathtracer_mpi_cpu > /dev/null
+
+echo "decomp,ranks,threads,seconds,msamples_per_s"
+for ((np = 1; np <= MAX_RANKS; np *= 2)); do
+    for decomp in image samples; do
+        # Sample split: each pass already takes np times the samples
+        passes=$PASSES
+        if [ "$decomp" = samples ]; then passes=$(( (PASSES + np - 1) / np )); fi
+        line=$(mpirun -np "$np" ./pathtracer_mpi_cpu "$passes" --threads "$THREADS" \
+                   --mpi-decomp "$decomp" | grep '^Rendered')
+        # "Rendered N iterations in S s (R Msamples/s)"
+        seconds=$(echo "$line" | awk '{print $5}')
+        rate=$(echo "$line" | awk '{print $7}' | tr -d '(')
+        echo "$decomp,$np,$THREADS,$seconds,$rate"
+    done
+done
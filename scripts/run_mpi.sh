@@ -4,4 +4,4 @@ mkdir -p ../build
 cd ../build
 cmake -DBUILD_MPI=ON -DBUILD_HIP=OFF -DBUILD_GUI=OFF ..
 make -j pathtracer_mpi_cpu
-mpirun -np 8 ./pathtracer_mpi_cpu 128
+mpirun -np 8 ./pathtracer_mpi_cpu 128 --threads 1
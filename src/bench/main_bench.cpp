@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "core/path_tracer.h"
+#include "core/options.h"
+#include "core/counters.h"
+
+// Micro and macro benchmarks of the CPU renderer.
+//
+//   pathtracer_bench [passes] [--threads N] [--simd ISA] [--spp N] ...
+//
+// Takes the same options as pathtracer_cpu; passes (default 8) is the
+// number of timed path_tracer_iteration calls per engine. Results go to
+// stdout as CSV rows "benchmark,metric,value,unit", one metric per row, so
+// the output of two builds can be joined and compared line by line
+// (scripts/compare_bench.sh). Progress goes to stderr.
+//
+// Micro benchmarks time one call on a fixed set of rays (or inputs) aimed
+// through the Cornell box, reporting the fastest of several trials. The
+// macro benchmarks time whole passes of each engine and count traced rays
+// with the per-thread counters: primary = camera rays, secondary = bounce
+// and shadow rays.
+
+using bench_clock = std::chrono::steady_clock;
+
+static void row(const std::string& bench, const char* metric, double value, const char* unit) {
+    std::cout << bench << "," << metric << "," << value << "," << unit << "\n";
+}
+
+static void row(const std::string& bench, const char* metric, const std::string& value) {
+    std::cout << bench << "," << metric << "," << value << ",\n";
+}
+
+// Keeps results observable so the timed loops are not optimized away
+static volatile double bench_sink;
+
+// Time body(), which performs ops_per_call operations, and return the
+// fastest trial in ns per operation. Each trial repeats body until it has
+// run for at least 50 ms.
+template <typename F>
+static double time_ns_per_op(long ops_per_call, F&& body) {
+    body();  // warm caches and branch predictors
+    long calls = 1;
+    for (;;) {
+        auto t0 = bench_clock::now();
+        for (long c = 0; c < calls; ++c) body();
+        double s = std::chrono::duration<double>(bench_clock::now() - t0).count();
+        if (s >= 0.05) break;
+        calls *= 2;
+    }
+    double best = 1e300;
+    for (int trial = 0; trial < 5; ++trial) {
+        auto t0 = bench_clock::now();
+        for (long c = 0; c < calls; ++c) body();
+        double s = std::chrono::duration<double>(bench_clock::now() - t0).count();
+        best = std::min(best, s);
+    }
+    return best * 1e9 / (double(calls) * ops_per_call);
+}
+
+// Rays from random points inside the box in uniformly random directions,
+// so every primitive sees a realistic mix of hits and misses
+static std::vector<ray> make_bench_rays(int n) {
+    std::vector<ray> rays;
+    rays.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        vec3 o(random_double(1, 554), random_double(1, 554), random_double(1, 554));
+        rays.emplace_back(o, random_unit_vector());
+    }
+    return rays;
+}
+
+// Time prim.hit over the bench rays; also reports the fraction that hit
+template <typename Prim>
+static void bench_primitive(const char* name, const Prim& prim, const std::vector<ray>& rays) {
+    long hits = 0;
+    double ns = time_ns_per_op(static_cast<long>(rays.size()), [&] {
+        hits = 0;
+        real t = 0;
+        for (const ray& r : rays) {
+            hit_record rec;
+            if (prim.hit(r, RAY_T_MIN, RAY_T_MAX, rec)) {
+                ++hits;
+                t += rec.t;
+            }
+        }
+        bench_sink = t;
+    });
+    row(name, "ns_per_op", ns, "ns");
+    row(name, "hit_fraction", double(hits) / rays.size(), "");
+}
+
+static void run_micro_benchmarks(const Scene& scene) {
+    const int N = 4096;
+    std::seed_seq seq{1234};
+    seed_random(seq);
+    std::vector<ray> rays = make_bench_rays(N);
+
+    std::cerr << "micro benchmarks...\n";
+    bench_primitive("sphere_hit", sphere(vec3(185, 82.5, 169), 82.5, 0), rays);
+    bench_primitive("xy_rect_hit", xy_rect(0, 555, 0, 555, 555, 0), rays);
+    bench_primitive("xz_rect_hit", xz_rect(0, 555, 0, 555, 0, 0), rays);
+    bench_primitive("yz_rect_hit", yz_rect(0, 555, 0, 555, 555, 0), rays);
+
+    // The whole scene through hittable_list (BVH + SIMD leaf kernels)
+    struct WorldHit {
+        const hittable_list& world;
+        bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+            return world.hit(r, t_min, t_max, rec);
+        }
+    };
+    bench_primitive("hittable_list_hit", WorldHit{scene.world}, rays);
+
+    std::vector<vec3> normals(N);
+    std::vector<real> u1(N), u2(N);
+    for (int i = 0; i < N; ++i) {
+        normals[i] = random_unit_vector();
+        u1[i] = real(random_double());
+        u2[i] = real(random_double());
+    }
+    double ns = time_ns_per_op(N, [&] {
+        vec3 sum(0, 0, 0);
+        for (int i = 0; i < N; ++i)
+            sum += sample_diffuse_direction(normals[i], u1[i], u2[i]);
+        bench_sink = sum.x() + sum.y() + sum.z();
+    });
+    row("sample_diffuse_direction", "ns_per_op", ns, "ns");
+
+    ns = time_ns_per_op(N, [&] {
+        double sum = 0.0;
+        for (int i = 0; i < N; ++i) sum += random_double();
+        bench_sink = sum;
+    });
+    row("random_double", "ns_per_op", ns, "ns");
+
+    // Light choice for NEE at random shading points, per strategy
+    LightList lights = scene.lights;
+    for (LightSampling strategy : {LightSampling::power, LightSampling::bvh}) {
+        lights.strategy = strategy;
+        ns = time_ns_per_op(N, [&] {
+            double sum = 0.0;
+            for (int i = 0; i < N; ++i) {
+                real pmf = 0;
+                sum += lights.pick(rays[i].origin(), normals[i], u1[i], pmf) + pmf;
+            }
+            bench_sink = sum;
+        });
+        row(strategy == LightSampling::power ? "light_pick_power" : "light_pick_bvh",
+            "ns_per_op", ns, "ns");
+    }
+
+    // Display transform of a frame's worth of accumulated pixels, with the
+    // scalar kernel for reference
+    const int P = 400 * 400;
+    std::vector<vec3> accum(P);
+    std::vector<real> count(P);
+    for (int i = 0; i < P; ++i) {
+        count[i] = real(1 + i % 16);
+        accum[i] = real(2 * random_double()) * count[i] * vec3(1, 1, 1) + vec3(0, 0.1, 0.2);
+    }
+    std::vector<uint32_t> argb(P);
+    auto bench_display = [&](const char* name, Tonemap tonemap, DisplayEncoding encoding,
+                             bool scalar) {
+        DisplayParams p;
+        p.tonemap = tonemap;
+        p.encoding = encoding;
+        double ns = time_ns_per_op(P, [&] {
+            if (scalar) simd_scalar::encode_display<true>(accum[0].e, count.data(), P, p, argb.data());
+            else encode_display_argb(accum[0].e, count.data(), P, p, argb.data());
+            bench_sink = argb[P / 2];
+        });
+        row(name, "ns_per_pixel", ns, "ns");
+    };
+    bench_display("display_encode", Tonemap::clamp, DisplayEncoding::gamma2, false);
+    bench_display("display_encode_scalar", Tonemap::clamp, DisplayEncoding::gamma2, true);
+    bench_display("display_encode_aces_srgb", Tonemap::aces, DisplayEncoding::srgb, false);
+    bench_display("display_encode_aces_srgb_scalar", Tonemap::aces, DisplayEncoding::srgb, true);
+}
+
+// Time `passes` progressive passes of one engine after an untimed warm-up
+// pass (which also builds the scheduler and queues)
+static void run_iteration_benchmark(const PathTracerConfig& cfg, RenderEngine engine,
+                                    int passes) {
+    std::string name = engine == RenderEngine::wavefront ? "iteration_wavefront"
+                                                         : "iteration_megakernel";
+    std::cerr << name << ": " << passes << " passes...\n";
+
+    PathTracerState state = make_default_state();
+    state.cfg = cfg;
+    state.cfg.engine = engine;
+    load_scene(state);
+    int pixels = state.cfg.image_width * state.cfg.image_height;
+
+    path_tracer_iteration(state);
+    double samples_before = state.stats.total_samples(pixels);
+    reset_counters();
+
+    auto t0 = bench_clock::now();
+    for (int p = 0; p < passes && !all_tiles_converged(state); ++p)
+        path_tracer_iteration(state);
+    double seconds = std::chrono::duration<double>(bench_clock::now() - t0).count();
+
+    CounterBlock c = counter_totals();
+    double samples = state.stats.total_samples(pixels) - samples_before;
+    double primary = double(c[Counter::camera_rays]);
+    double bounce = double(c[Counter::bounce_rays]);
+    double shadow = double(c[Counter::shadow_rays]);
+    double rays = primary + bounce + shadow;
+
+    row(name, "seconds", seconds, "s");
+    row(name, "samples", samples, "");
+    row(name, "primary_rays", primary, "");
+    row(name, "secondary_rays", bounce + shadow, "");
+    row(name, "bounce_rays", bounce, "");
+    row(name, "shadow_rays", shadow, "");
+    row(name, "rays_per_sample", rays / samples, "");
+    row(name, "mrays_per_s", rays / seconds * 1e-6, "Mrays/s");
+    row(name, "msamples_per_s", samples / seconds * 1e-6, "Msamples/s");
+    row(name, "ns_per_sample", seconds * 1e9 / samples, "ns");
+    if (STAGE_TIMERS_ENABLED) {
+        for (int s = 0; s < NUM_STAGES; ++s) {
+            Stage stage = static_cast<Stage>(s);
+            row(name, (std::string("stage_seconds_") + stage_name(stage)).c_str(),
+                double(c[stage]) / ticks_per_second(), "s");
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    PathTracerConfig cfg;
+    RunOptions opt;
+    opt.max_iterations = 8;
+    if (!parse_options(argc, argv, opt, cfg)) return 1;
+
+    Scene scene = make_scene(cfg.scene);
+    std::cout.precision(10);
+    std::cout << "benchmark,metric,value,unit\n";
+    row("build", "real", sizeof(real) == sizeof(float) ? "float32" : "float64");
+    row("build", "simd", simd_isa_name(active_simd_isa()));
+    row("build", "threads", resolve_thread_count(cfg.num_threads), "");
+    row("build", "image", std::to_string(cfg.image_width) + "x" +
+                          std::to_string(cfg.image_height));
+    row("build", "spp_per_iteration", cfg.spp_per_iteration, "");
+    row("build", "max_depth", cfg.max_depth, "");
+    row("build", "lights", static_cast<double>(scene.lights.size()), "");
+
+    run_micro_benchmarks(scene);
+    run_iteration_benchmark(cfg, RenderEngine::megakernel, opt.max_iterations);
+    run_iteration_benchmark(cfg, RenderEngine::wavefront, opt.max_iterations);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "ray.h"
+#include <algorithm>
+#include <limits>
+
+template <typename T>
+class aabb_t {
+public:
+    vec3_t<T> minimum;
+    vec3_t<T> maximum;
+
+    // Default box is empty, so it can be grown with surrounding_box()
+    aabb_t()
+        : minimum( std::numeric_limits<T>::infinity(),
+                   std::numeric_limits<T>::infinity(),
+                   std::numeric_limits<T>::infinity()),
+          maximum(-std::numeric_limits<T>::infinity(),
+                  -std::numeric_limits<T>::infinity(),
+                  -std::numeric_limits<T>::infinity()) {}
+    aabb_t(const vec3_t<T>& a, const vec3_t<T>& b) : minimum(a), maximum(b) {}
+
+    vec3_t<T> min() const { return minimum; }
+    vec3_t<T> max() const { return maximum; }
+
+    vec3_t<T> centroid() const { return T(0.5) * (minimum + maximum); }
+
+    T surface_area() const {
+        vec3_t<T> d = maximum - minimum;
+        if (d.x() < 0 || d.y() < 0 || d.z() < 0) return T(0);
+        return T(2) * (d.x()*d.y() + d.y()*d.z() + d.z()*d.x());
+    }
+
+    int longest_axis() const {
+        vec3_t<T> d = maximum - minimum;
+        if (d.x() > d.y() && d.x() > d.z()) return 0;
+        return d.y() > d.z() ? 1 : 2;
+    }
+
+    void grow(const vec3_t<T>& p) {
+        for (int a = 0; a < 3; ++a) {
+            minimum[a] = std::min(minimum[a], p[a]);
+            maximum[a] = std::max(maximum[a], p[a]);
+        }
+    }
+
+    void grow(const aabb_t& b) {
+        grow(b.minimum);
+        grow(b.maximum);
+    }
+
+    // Slab test with a precomputed reciprocal direction. A NaN from a ray
+    // lying in a slab plane fails both comparisons and leaves the interval
+    // untouched, which errs on the side of reporting a hit.
+    bool hit(const vec3_t<T>& orig, const vec3_t<T>& inv_dir,
+             T t_min, T t_max) const {
+        for (int a = 0; a < 3; ++a) {
+            T t0 = (minimum[a] - orig[a]) * inv_dir[a];
+            T t1 = (maximum[a] - orig[a]) * inv_dir[a];
+            if (inv_dir[a] < T(0)) std::swap(t0, t1);
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max < t_min) return false;
+        }
+        return true;
+    }
+};
+
+using aabb = aabb_t<real>;
+
+template <typename T>
+inline aabb_t<T> surrounding_box(const aabb_t<T>& box0, const aabb_t<T>& box1) {
+    aabb_t<T> out = box0;
+    out.grow(box1);
+    return out;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include "vec3.h"
+
+// First-hit auxiliary buffers (AOVs) guiding the denoiser: what the camera
+// ray of each sample hit. Like the radiance they are summed per pixel over
+// samples, so edges come out antialiased, and are kept with their own
+// sample count so a driver can reduce them separately (MPI) or start them
+// later than the radiance (after a resume).
+
+// First hit of one camera ray; all zero when it escaped
+struct FirstHit {
+    vec3 albedo;    // diffuse albedo; emitters count as white
+    vec3 normal;    // shading normal, facing the camera
+    vec3 emission;  // radiance emitted toward the camera
+    real depth = 0;  // distance from the camera
+};
+
+struct AovBuffers {
+    std::vector<vec3> albedo, normal, emission;  // sums over samples
+    std::vector<real> depth, count;
+
+    void reset(int pixels) {
+        albedo.assign(pixels, vec3(0,0,0));
+        normal.assign(pixels, vec3(0,0,0));
+        emission.assign(pixels, vec3(0,0,0));
+        depth.assign(pixels, real(0));
+        count.assign(pixels, real(0));
+    }
+
+    // Add n samples' first hits (summed in hit) to pixel idx
+    void add(int idx, const FirstHit& hit, real n) {
+        albedo[idx] += hit.albedo;
+        normal[idx] += hit.normal;
+        emission[idx] += hit.emission;
+        depth[idx] += hit.depth;
+        count[idx] += n;
+    }
+};
@@ -0,0 +1,229 @@
+#pragma once
+#include "hittable.h"
+#include <algorithm>
+#include <vector>
+
+// Flattened bounding volume hierarchy built with the binned surface area
+// heuristic. Nodes are stored depth-first in one array: an interior node's
+// left child immediately follows it and `offset` points at the right child;
+// a leaf covers primitives [offset, offset + count) of the reordered
+// primitive array. One node is one cache line.
+struct alignas(64) bvh_flat_node {
+    aabb box;
+    int offset;
+    int count;   // 0 for interior nodes
+    int axis;    // split axis of interior nodes
+};
+
+inline constexpr int BVH_MAX_LEAF_SIZE = 4;
+inline constexpr int BVH_MAX_DEPTH = 60;
+inline constexpr int BVH_SAH_BINS = 16;
+inline constexpr double BVH_TRAVERSAL_COST = 0.125;  // relative to one primitive test
+
+namespace bvh_detail {
+
+struct build_prim {
+    aabb box;
+    vec3 centroid;
+    int index;
+};
+
+inline int build_recursive(std::vector<build_prim>& prims, int begin, int end,
+                           int depth, int max_leaf, std::vector<bvh_flat_node>& nodes)
+{
+    aabb bounds, cbounds;
+    for (int i = begin; i < end; ++i) {
+        bounds.grow(prims[i].box);
+        cbounds.grow(prims[i].centroid);
+    }
+
+    int node_index = static_cast<int>(nodes.size());
+    nodes.push_back(bvh_flat_node{bounds, begin, end - begin, 0});
+    int n = end - begin;
+    if (n == 1 || depth >= BVH_MAX_DEPTH)
+        return node_index;
+
+    // Evaluate SAH over binned centroids on every axis
+    int best_axis = -1;
+    int best_split = 0;
+    double best_cost = std::numeric_limits<double>::infinity();
+    double parent_area = bounds.surface_area();
+
+    for (int axis = 0; axis < 3; ++axis) {
+        double lo = cbounds.minimum[axis];
+        double extent = cbounds.maximum[axis] - lo;
+        if (extent <= 0.0) continue;
+
+        int bin_count[BVH_SAH_BINS] = {};
+        aabb bin_box[BVH_SAH_BINS];
+        for (int i = begin; i < end; ++i) {
+            int b = static_cast<int>(BVH_SAH_BINS * (prims[i].centroid[axis] - lo) / extent);
+            b = std::min(b, BVH_SAH_BINS - 1);
+            bin_count[b]++;
+            bin_box[b].grow(prims[i].box);
+        }
+
+        // Sweep from the right to get suffix areas, then from the left
+        double right_area[BVH_SAH_BINS];
+        int right_count[BVH_SAH_BINS];
+        aabb acc;
+        int cnt = 0;
+        for (int b = BVH_SAH_BINS - 1; b > 0; --b) {
+            acc.grow(bin_box[b]);
+            cnt += bin_count[b];
+            right_area[b] = acc.surface_area();
+            right_count[b] = cnt;
+        }
+
+        acc = aabb();
+        cnt = 0;
+        for (int b = 1; b < BVH_SAH_BINS; ++b) {
+            acc.grow(bin_box[b-1]);
+            cnt += bin_count[b-1];
+            if (cnt == 0 || right_count[b] == 0) continue;
+            double cost = BVH_TRAVERSAL_COST +
+                (cnt * acc.surface_area() + right_count[b] * right_area[b]) / parent_area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    int mid;
+    if (best_axis < 0) {
+        // All centroids coincide: SAH cannot separate them
+        if (n <= max_leaf) return node_index;
+        mid = (begin + end) / 2;
+    } else {
+        if (n <= max_leaf && best_cost >= static_cast<double>(n))
+            return node_index;
+
+        double lo = cbounds.minimum[best_axis];
+        double extent = cbounds.maximum[best_axis] - lo;
+        auto it = std::partition(prims.begin() + begin, prims.begin() + end,
+            [&](const build_prim& p) {
+                int b = static_cast<int>(BVH_SAH_BINS * (p.centroid[best_axis] - lo) / extent);
+                return std::min(b, BVH_SAH_BINS - 1) < best_split;
+            });
+        mid = static_cast<int>(it - prims.begin());
+    }
+
+    nodes[node_index].count = 0;
+    nodes[node_index].axis = best_axis < 0 ? 0 : best_axis;
+    build_recursive(prims, begin, mid, depth + 1, max_leaf, nodes);
+    int right = build_recursive(prims, mid, end, depth + 1, max_leaf, nodes);
+    nodes[node_index].offset = right;
+    return node_index;
+}
+
+} // namespace bvh_detail
+
+// Builds nodes over the given primitive boxes. `order` receives the
+// primitive permutation that leaves index into. Leaves hold at most
+// max_leaf primitives unless their centroids coincide.
+inline void build_bvh(const std::vector<aabb>& boxes,
+                      std::vector<bvh_flat_node>& nodes,
+                      std::vector<int>& order,
+                      int max_leaf = BVH_MAX_LEAF_SIZE)
+{
+    nodes.clear();
+    order.clear();
+    if (boxes.empty()) return;
+
+    std::vector<bvh_detail::build_prim> prims(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i)
+        prims[i] = {boxes[i], boxes[i].centroid(), static_cast<int>(i)};
+
+    nodes.reserve(2 * boxes.size());
+    bvh_detail::build_recursive(prims, 0, static_cast<int>(prims.size()), 0, max_leaf, nodes);
+
+    order.resize(prims.size());
+    for (size_t i = 0; i < prims.size(); ++i)
+        order[i] = prims[i].index;
+}
+
+// Iterative front-to-back traversal. leaf(first, count, t_max) tests a leaf's
+// primitives and returns true (shrinking t_max) when it finds a closer hit.
+template <typename LeafFn>
+inline bool traverse_bvh(const std::vector<bvh_flat_node>& nodes, const ray& r,
+                         real t_min, real t_max, LeafFn&& leaf)
+{
+    if (nodes.empty()) return false;
+
+    vec3 orig = r.origin();
+    vec3 dir = r.direction();
+    vec3 inv_dir(real(1) / dir.x(), real(1) / dir.y(), real(1) / dir.z());
+    bool dir_neg[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+    int stack[BVH_MAX_DEPTH + 4];
+    int sp = 0;
+    int current = 0;
+    bool hit_anything = false;
+
+    while (true) {
+        const bvh_flat_node& node = nodes[current];
+        if (node.box.hit(orig, inv_dir, t_min, t_max)) {
+            if (node.count > 0) {
+                if (leaf(node.offset, node.count, t_max))
+                    hit_anything = true;
+                if (sp == 0) break;
+                current = stack[--sp];
+            } else if (dir_neg[node.axis]) {
+                // Ray travels toward -axis, so the right child is nearer
+                stack[sp++] = current + 1;
+                current = node.offset;
+            } else {
+                stack[sp++] = node.offset;
+                current = current + 1;
+            }
+        } else {
+            if (sp == 0) break;
+            current = stack[--sp];
+        }
+    }
+    return hit_anything;
+}
+
+// Any-hit traversal for occlusion queries. leaf(first, count) returns true
+// if something in the leaf blocks [t_min, t_max]; the walk stops there.
+// The interval never shrinks, so child order only matters for how soon a
+// blocker is found.
+template <typename LeafFn>
+inline bool occluded_bvh(const std::vector<bvh_flat_node>& nodes, const ray& r,
+                         real t_min, real t_max, LeafFn&& leaf)
+{
+    if (nodes.empty()) return false;
+
+    vec3 orig = r.origin();
+    vec3 dir = r.direction();
+    vec3 inv_dir(real(1) / dir.x(), real(1) / dir.y(), real(1) / dir.z());
+    bool dir_neg[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+    int stack[BVH_MAX_DEPTH + 4];
+    int sp = 0;
+    int current = 0;
+
+    while (true) {
+        const bvh_flat_node& node = nodes[current];
+        if (node.box.hit(orig, inv_dir, t_min, t_max)) {
+            if (node.count > 0) {
+                if (leaf(node.offset, node.count))
+                    return true;
+                if (sp == 0) break;
+                current = stack[--sp];
+            } else if (dir_neg[node.axis]) {
+                stack[sp++] = current + 1;
+                current = node.offset;
+            } else {
+                stack[sp++] = node.offset;
+                current = current + 1;
+            }
+        } else {
+            if (sp == 0) break;
+            current = stack[--sp];
+        }
+    }
+    return false;
+}
@@ -1,30 +1,40 @@
 #pragma once
 #include "ray.h"
 
-class camera {
+template <typename T>
+class camera_t {
 public:
-    vec3 origin;
-    vec3 lower_left_corner;
-    vec3 horizontal;
-    vec3 vertical;
+    vec3_t<T> origin;
+    vec3_t<T> lower_left_dir;  // origin -> lower-left viewport corner
+    vec3_t<T> horizontal;
+    vec3_t<T> vertical;
 
-    camera(vec3 lookfrom, vec3 lookat, vec3 vup, double vfov, double aspect_ratio) {
+    // The basis is set up in double and rounded once to T. Rays are built
+    // from lower_left_dir rather than a world-space corner minus origin,
+    // which in float would cancel away most of the direction's bits when
+    // the camera sits far from the world origin.
+    camera_t(vec3_t<double> lookfrom, vec3_t<double> lookat, vec3_t<double> vup,
+             double vfov, double aspect_ratio) {
         double theta = vfov * M_PI / 180.0;
         double h = std::tan(theta/2);
         double viewport_height = 2.0 * h;
         double viewport_width = aspect_ratio * viewport_height;
 
-        vec3 w = unit_vector(lookfrom - lookat);
-        vec3 u = unit_vector(cross(vup, w));
-        vec3 v = cross(w, u);
+        vec3_t<double> w = unit_vector(lookfrom - lookat);
+        vec3_t<double> u = unit_vector(cross(vup, w));
+        vec3_t<double> v = cross(w, u);
 
-        origin = lookfrom;
-        horizontal = viewport_width * u;
-        vertical   = viewport_height * v;
-        lower_left_corner = origin - horizontal/2 - vertical/2 - w;
+        vec3_t<double> hor = viewport_width * u;
+        vec3_t<double> ver = viewport_height * v;
+        origin = vec3_t<T>(lookfrom);
+        horizontal = vec3_t<T>(hor);
+        vertical   = vec3_t<T>(ver);
+        lower_left_dir = vec3_t<T>(-hor/2 - ver/2 - w);
     }
 
-    ray get_ray(double s, double t) const {
-        return ray(origin, lower_left_corner + s*horizontal + t*vertical - origin);
+    ray_t<T> get_ray(T s, T t) const {
+        return ray_t<T>(origin, lower_left_dir + s*horizontal + t*vertical);
     }
 };
+
+using camera = camera_t<real>;
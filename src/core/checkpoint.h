@@ -0,0 +1,222 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "path_tracer.h"
+
+// Checkpoint/resume of the accumulation state through a memory-mapped file.
+//
+// The file is mapped once and kept mapped for the whole render. It holds
+// two slots, each with the per-pixel arrays (accum_buffer and the sample
+// count / luminance mean / M2 of ConvergenceStats) for a range of image
+// rows, plus the tile retirement flags. A checkpoint copies the arrays into
+// the slot not currently valid, msyncs it, then flips the header to point
+// at it and msyncs the header, so a crash mid-checkpoint leaves the
+// previous one intact.
+//
+// No RNG state is stored: the Sampler is counter-based and every pixel's
+// next sample index is its sample count (or, for the MPI driver, follows
+// from the pass count), so resuming continues the exact sample sequence.
+//
+// A shard covers rows [row_begin, row_end); the CPU driver writes one shard
+// holding the whole frame, the MPI driver one per rank.
+
+inline constexpr char CHECKPOINT_MAGIC[8] = {'P', 'T', 'C', 'K', 'P', 'T', '4', '\0'};
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t real_size;
+    int32_t width, height, row_begin, row_end, num_tiles;
+    // Config that changes the estimator or the sample sequence
+    int32_t tile_size, max_depth, spp_per_iteration, adaptive, adaptive_max_spp;
+    uint32_t seed;
+    int32_t scene, light_sampling, direct_lighting;
+    double adaptive_threshold;
+    // Slot bookkeeping
+    int32_t valid_slot;  // -1 until the first checkpoint completes
+    int32_t iterations[2];
+};
+
+class Checkpoint {
+public:
+    Checkpoint() = default;
+    ~Checkpoint() { close(); }
+
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator=(const Checkpoint&) = delete;
+
+    // Map path for the given shard of state's frame. With resume, the file
+    // must already hold a checkpoint of the same frame and config; without,
+    // it is created (or its old contents discarded). Returns false, with the
+    // reason in error(), if the file cannot be used.
+    bool open(const std::string& path, const PathTracerState& state,
+              int row_begin, int row_end, bool resume) {
+        close();
+        int W = state.cfg.image_width;
+        pixels_ = size_t(W) * (row_end - row_begin);
+        first_pixel_ = size_t(W) * row_begin;
+        num_tiles_ = make_tiles(W, state.cfg.image_height, state.cfg.tile_size).size();
+        // accum (3 reals) + count, mean, M2 per pixel; flags per tile
+        slot_bytes_ = align(pixels_ * 6 * sizeof(real) + num_tiles_);
+        size_t bytes = align(sizeof(CheckpointHeader)) + 2 * slot_bytes_;
+
+        fd_ = ::open(path.c_str(), resume ? O_RDWR : O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0) return fail(path + ": cannot open");
+        struct stat st;
+        if (fstat(fd_, &st) != 0) return fail(path + ": cannot stat");
+        bool same_size = size_t(st.st_size) == bytes;
+        if (resume && !same_size)
+            return fail(path + ": checkpoint does not match this frame size or config");
+        if (!same_size && ftruncate(fd_, static_cast<off_t>(bytes)) != 0)
+            return fail(path + ": cannot resize");
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) return fail(path + ": mmap failed");
+        base_ = static_cast<char*>(p);
+        bytes_ = bytes;
+
+        CheckpointHeader expected = make_header(state, row_begin, row_end);
+        if (resume) {
+            if (!same_config(*header(), expected))
+                return fail(path + ": checkpoint does not match this frame size or config");
+            if (!has_state())
+                return fail(path + ": no completed checkpoint");
+        } else {
+            *header() = expected;
+            msync(base_, align(sizeof(CheckpointHeader)), MS_SYNC);
+        }
+        return true;
+    }
+
+    const std::string& error() const { return error_; }
+
+    // True if the mapped file holds a completed checkpoint
+    bool has_state() const { return base_ && header()->valid_slot >= 0; }
+
+    int iterations() const { return has_state() ? header()->iterations[header()->valid_slot] : 0; }
+
+    // Copy this shard's rows of state into the spare slot and make it the
+    // valid one
+    bool save(const PathTracerState& state) {
+        if (!base_) return false;
+        CheckpointHeader* h = header();
+        int slot = h->valid_slot == 0 ? 1 : 0;
+        char* s = slot_ptr(slot);
+        const ConvergenceStats& st = state.stats;
+        s = put(s, state.accum_buffer[first_pixel_].e, 3 * pixels_);
+        s = put(s, &st.sample_count[first_pixel_], pixels_);
+        s = put(s, &st.lum_mean[first_pixel_], pixels_);
+        s = put(s, &st.lum_m2[first_pixel_], pixels_);
+        size_t flags = std::min(num_tiles_, state.tile_converged.size());
+        std::memcpy(s, state.tile_converged.data(), flags);
+        std::memset(s + flags, 0, num_tiles_ - flags);
+        if (msync(slot_ptr(slot), slot_bytes_, MS_SYNC) != 0) return false;
+
+        h->iterations[slot] = state.iterations;
+        h->valid_slot = slot;
+        return msync(base_, align(sizeof(CheckpointHeader)), MS_SYNC) == 0;
+    }
+
+    // Copy the valid slot back into this shard's rows of state and set the
+    // iteration count and tile flags. Call finish_resume once every shard's
+    // rows are in place.
+    bool load(PathTracerState& state) const {
+        if (!has_state()) return false;
+        const char* s = slot_ptr(header()->valid_slot);
+        ConvergenceStats& st = state.stats;
+        s = get(s, state.accum_buffer[first_pixel_].e, 3 * pixels_);
+        s = get(s, &st.sample_count[first_pixel_], pixels_);
+        s = get(s, &st.lum_mean[first_pixel_], pixels_);
+        s = get(s, &st.lum_m2[first_pixel_], pixels_);
+        state.tile_converged.assign(s, s + num_tiles_);
+        state.iterations = iterations();
+        return true;
+    }
+
+    void close() {
+        if (base_) munmap(base_, bytes_);
+        if (fd_ >= 0) ::close(fd_);
+        base_ = nullptr;
+        fd_ = -1;
+    }
+
+private:
+    static size_t align(size_t n) { return (n + 4095) & ~size_t(4095); }
+
+    static CheckpointHeader make_header(const PathTracerState& state, int row_begin, int row_end) {
+        const PathTracerConfig& cfg = state.cfg;
+        CheckpointHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic));
+        h.real_size = sizeof(real);
+        h.width = cfg.image_width;
+        h.height = cfg.image_height;
+        h.row_begin = row_begin;
+        h.row_end = row_end;
+        h.num_tiles = static_cast<int32_t>(make_tiles(cfg.image_width, cfg.image_height,
+                                                      cfg.tile_size).size());
+        h.tile_size = cfg.tile_size;
+        h.max_depth = cfg.max_depth;
+        h.spp_per_iteration = cfg.spp_per_iteration;
+        h.adaptive = cfg.adaptive ? 1 : 0;
+        h.adaptive_max_spp = cfg.adaptive_max_spp;
+        h.seed = cfg.seed;
+        h.scene = static_cast<int32_t>(cfg.scene);
+        h.light_sampling = static_cast<int32_t>(cfg.light_sampling);
+        h.direct_lighting = static_cast<int32_t>(cfg.direct_lighting);
+        h.adaptive_threshold = cfg.adaptive_threshold;
+        h.valid_slot = -1;
+        return h;
+    }
+
+    // Everything but the slot bookkeeping must match
+    static bool same_config(const CheckpointHeader& a, const CheckpointHeader& b) {
+        return std::memcmp(&a, &b, offsetof(CheckpointHeader, valid_slot)) == 0;
+    }
+
+    template <typename T>
+    static char* put(char* dst, const T* src, size_t n) {
+        std::memcpy(dst, src, n * sizeof(T));
+        return dst + n * sizeof(T);
+    }
+
+    template <typename T>
+    static const char* get(const char* src, T* dst, size_t n) {
+        std::memcpy(dst, src, n * sizeof(T));
+        return src + n * sizeof(T);
+    }
+
+    bool fail(const std::string& why) {
+        close();
+        error_ = why;
+        return false;
+    }
+
+    CheckpointHeader* header() const { return reinterpret_cast<CheckpointHeader*>(base_); }
+    char* slot_ptr(int slot) const {
+        return base_ + align(sizeof(CheckpointHeader)) + size_t(slot) * slot_bytes_;
+    }
+
+    int fd_ = -1;
+    char* base_ = nullptr;
+    size_t bytes_ = 0, slot_bytes_ = 0;
+    size_t pixels_ = 0, first_pixel_ = 0, num_tiles_ = 0;
+    std::string error_;
+};
+
+// After every shard is loaded: rebuild the tile list and the per-tile and
+// global relMSE the adaptive budget reads
+inline void finish_resume(PathTracerState& state) {
+    prepare_scheduler(state);  // keeps the restored tile flags
+    for (size_t t = 0; t < state.tiles.size(); ++t) {
+        state.stats.tile_residual[t] = 0.0;
+        state.stats.tile_rel_mse[t] = state.stats.tile_rel_mse_sum(state.cfg.image_width,
+                                                                   state.tiles[t]);
+    }
+    state.stats.reduce(state.cfg.image_width * state.cfg.image_height);
+}
@@ -0,0 +1,198 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Per-thread hot-path instrumentation: event counters and per-stage time.
+//
+// Every thread owns a cache-line aligned block and updates it without
+// atomics; blocks are registered once per thread and never freed, so counts
+// of threads that have exited still add up. counter_totals() reads the
+// blocks unsynchronized and must only be called while no pass is in flight
+// (TileScheduler::run returning orders the workers' writes before it).
+//
+// Counting costs one add to a thread-local block per event and is on by
+// default; define PT_NO_COUNTERS (CMake ENABLE_COUNTERS=OFF) to compile
+// every hook out, after which the totals read 0. Stage time needs two TSC
+// reads per timed call, which slows the megakernel (timed per call inside
+// ray_color) by about a quarter, so it is opt-in: PT_STAGE_TIMERS (CMake
+// ENABLE_STAGE_TIMERS=ON).
+enum class Counter : int {
+    camera_rays,             // closest-hit queries from the camera
+    bounce_rays,             // closest-hit queries after a BSDF bounce
+    shadow_rays,             // NEE visibility queries
+    sphere_tests,            // ray-primitive tests, SIMD lanes included
+    xy_rect_tests,
+    xz_rect_tests,
+    yz_rect_tests,
+    escaped_paths,           // path left the scene
+    light_hits,              // path ended on an emitter
+    rr_terminations,         // killed by Russian roulette
+    max_depth_terminations,  // survived roulette with no depth left
+    nee_samples,             // light samples drawn
+    nee_backfacing,          // light sample rejected: behind surface or light
+    nee_occluded,            // shadow ray blocked
+    count
+};
+
+inline constexpr int NUM_COUNTERS = static_cast<int>(Counter::count);
+
+// Disjoint parts of tracing a sample. The megakernel times each call site
+// inside ray_color; the wavefront engine times its stage loops (shade then
+// covers light sampling and BSDF sampling, scatter the roulette pass).
+enum class Stage : int {
+    generate,    // camera rays
+    intersect,   // closest-hit queries
+    shade,       // light sampling (NEE)
+    shadow,      // shadow rays
+    scatter,     // roulette and BSDF sampling
+    accumulate,  // merging samples into the frame
+    count
+};
+
+inline constexpr int NUM_STAGES = static_cast<int>(Stage::count);
+
+#ifdef PT_NO_COUNTERS
+inline constexpr bool COUNTERS_ENABLED = false;
+#else
+inline constexpr bool COUNTERS_ENABLED = true;
+#endif
+
+#if defined(PT_STAGE_TIMERS) && !defined(PT_NO_COUNTERS)
+inline constexpr bool STAGE_TIMERS_ENABLED = true;
+#else
+inline constexpr bool STAGE_TIMERS_ENABLED = false;
+#endif
+
+struct alignas(64) CounterBlock {
+    uint64_t v[NUM_COUNTERS] = {};
+    uint64_t ticks[NUM_STAGES] = {};
+
+    uint64_t operator[](Counter c) const { return v[static_cast<int>(c)]; }
+    uint64_t operator[](Stage s) const { return ticks[static_cast<int>(s)]; }
+};
+
+struct CounterRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<CounterBlock>> blocks;
+};
+
+inline CounterRegistry& counter_registry() {
+    static CounterRegistry registry;
+    return registry;
+}
+
+inline CounterBlock* register_counter_block() {
+    CounterRegistry& reg = counter_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.blocks.push_back(std::make_unique<CounterBlock>());
+    return reg.blocks.back().get();
+}
+
+inline CounterBlock& thread_counters() {
+    thread_local CounterBlock* block = register_counter_block();
+    return *block;
+}
+
+inline uint64_t read_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// read_ticks() rate, measured once against steady_clock over 20 ms
+inline double ticks_per_second() {
+    static const double rate = [] {
+        auto c0 = std::chrono::steady_clock::now();
+        uint64_t t0 = read_ticks();
+        double s = 0.0;
+        while (s < 0.02)
+            s = std::chrono::duration<double>(std::chrono::steady_clock::now() - c0).count();
+        return double(read_ticks() - t0) / s;
+    }();
+    return rate;
+}
+
+inline void count_event(Counter c, uint64_t n = 1) {
+    if constexpr (COUNTERS_ENABLED)
+        thread_counters().v[static_cast<int>(c)] += n;
+}
+
+#if defined(PT_STAGE_TIMERS) && !defined(PT_NO_COUNTERS)
+// Adds the lifetime of the scope to a stage of the calling thread
+class StageTimer {
+public:
+    explicit StageTimer(Stage s) : block_(thread_counters()), stage_(s), t0_(read_ticks()) {}
+    ~StageTimer() { block_.ticks[static_cast<int>(stage_)] += read_ticks() - t0_; }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    CounterBlock& block_;
+    Stage stage_;
+    uint64_t t0_;
+};
+#else
+struct StageTimer {
+    explicit StageTimer(Stage) {}
+};
+#endif
+
+// Sum over every thread's block
+inline CounterBlock counter_totals() {
+    CounterRegistry& reg = counter_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    CounterBlock total;
+    for (const auto& b : reg.blocks) {
+        for (int i = 0; i < NUM_COUNTERS; ++i) total.v[i] += b->v[i];
+        for (int i = 0; i < NUM_STAGES; ++i) total.ticks[i] += b->ticks[i];
+    }
+    return total;
+}
+
+inline void reset_counters() {
+    CounterRegistry& reg = counter_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto& b : reg.blocks) *b = CounterBlock();
+}
+
+inline const char* counter_name(Counter c) {
+    switch (c) {
+        case Counter::camera_rays: return "camera_rays";
+        case Counter::bounce_rays: return "bounce_rays";
+        case Counter::shadow_rays: return "shadow_rays";
+        case Counter::sphere_tests: return "sphere_tests";
+        case Counter::xy_rect_tests: return "xy_rect_tests";
+        case Counter::xz_rect_tests: return "xz_rect_tests";
+        case Counter::yz_rect_tests: return "yz_rect_tests";
+        case Counter::escaped_paths: return "escaped_paths";
+        case Counter::light_hits: return "light_hits";
+        case Counter::rr_terminations: return "rr_terminations";
+        case Counter::max_depth_terminations: return "max_depth_terminations";
+        case Counter::nee_samples: return "nee_samples";
+        case Counter::nee_backfacing: return "nee_backfacing";
+        case Counter::nee_occluded: return "nee_occluded";
+        default: return "?";
+    }
+}
+
+inline const char* stage_name(Stage s) {
+    switch (s) {
+        case Stage::generate: return "generate";
+        case Stage::intersect: return "intersect";
+        case Stage::shade: return "shade";
+        case Stage::shadow: return "shadow";
+        case Stage::scatter: return "scatter";
+        case Stage::accumulate: return "accumulate";
+        default: return "?";
+    }
+}
@@ -0,0 +1,302 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "path_tracer.h"
+
+// Edge-avoiding a-trous wavelet denoiser (Dammertz et al. 2010) with the
+// variance-guided luminance edge stop of SVGF (Schied et al. 2017).
+//
+// Emission seen directly by the camera is set aside and the rest of the
+// noisy mean radiance is divided by the first-hit albedo, so only lighting
+// is blurred while lights and surface colour stay sharp. It is filtered
+// with a 5x5 B3-spline kernel at steps 1, 2, 4, ..., then the albedo is
+// multiplied back in and the emission added. Each tap is weighted down by
+// how much its lighting differs relative to the centre's noise (standard
+// deviation of the mean), how far its normal turns, and how far its depth
+// leaves the centre's depth slope. The variance is filtered alongside with
+// squared weights, so the luminance stop tightens as noise is removed.
+// Levels run one after another; rows within a level are spread over the
+// worker pool.
+//
+// Pixels without first-hit guides (no AOV samples yet, e.g. right after a
+// resume) are filtered on the luminance stop alone.
+
+struct DenoiseSettings {
+    int levels = 4;              // a-trous passes; the last reaches 2^(levels+1) pixels out
+    float sigma_color = 4.0f;    // luminance stop, in standard deviations of the noise
+    float normal_sharpness = 128.0f;  // weight exp(-sharpness * (1 - n.n'))
+    float sigma_depth = 1.0f;    // depth stop, in units of the local depth slope
+};
+
+class Denoiser {
+public:
+    // Denoise state's current image into out (mean radiance per pixel), on
+    // pool's workers if one is given. Returns the filter time in ms.
+    double run(const PathTracerState& state, std::vector<vec3>& out, TileScheduler* pool,
+               const DenoiseSettings& settings = DenoiseSettings()) {
+        auto t0 = std::chrono::steady_clock::now();
+        w_ = state.cfg.image_width;
+        h_ = state.cfg.image_height;
+        size_t n = size_t(w_) * h_;
+        for (int b = 0; b < 2; ++b) {
+            color_[b].resize(3 * n);
+            var_[b].resize(n);
+        }
+        albedo_.resize(3 * n);
+        normal_.resize(3 * n);
+        emission_.resize(3 * n);
+        depth_.resize(n);
+        slope_.resize(n);
+
+        int min_rows = std::max(1, PARALLEL_ENCODE_MIN_PIXELS / std::max(1, w_));
+        auto rows = [&](auto&& fn) {
+            parallel_for_ranges(pool, h_, min_rows, [&](int j0, int j1) {
+                for (int j = j0; j < j1; ++j) fn(j);
+            });
+        };
+
+        rows([&](int j) { for (int i = 0; i < w_; ++i) prepare(state, j * w_ + i); });
+        rows([&](int j) { for (int i = 0; i < w_; ++i) depth_slope(i, j); });
+        int cur = 0;
+        for (int level = 0; level < settings.levels; ++level) {
+            rows([&](int j) { filter_row(settings, 1 << level, cur, j); });
+            cur ^= 1;
+        }
+
+        out.resize(n);
+        rows([&](int j) {
+            for (int i = 0; i < w_; ++i) {
+                size_t p = size_t(j) * w_ + i;
+                const float* c = &color_[cur][3 * p];
+                const float* a = &albedo_[3 * p];
+                const float* e = &emission_[3 * p];
+                out[p] = vec3(real(c[0] * a[0] + e[0]), real(c[1] * a[1] + e[1]),
+                              real(c[2] * a[2] + e[2]));
+            }
+        });
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0)
+            .count();
+    }
+
+private:
+    static constexpr float ALBEDO_EPS = 1e-3f;
+    static constexpr float WEIGHT_EPS = 1e-6f;
+    static constexpr float MAX_EXPONENT = 16.0f;  // weights below exp(-16) make no difference
+
+    static float lum(const float* c) { return 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2]; }
+
+    // exp(-e) for e >= 0 to 0.02%, plenty for filter weights: 2^-x from the
+    // exponent bits and a least-squares cubic for the fraction
+    static float exp_neg(float e) {
+        float x = std::min(e * 1.44269504f, 126.0f);
+        int32_t xi = static_cast<int32_t>(x);  // x >= 0: truncation is floor
+        float f = x - static_cast<float>(xi);  // 2^-f on [0, 1)
+        float p = 0.99986364f + f * (-0.69068904f + f * (0.22966882f + f * -0.03891160f));
+        int32_t bits = (127 - xi) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+        return p * scale;
+    }
+
+    // Guides, demodulated lighting and its variance of pixel p
+    void prepare(const PathTracerState& state, size_t p) {
+        real n = state.stats.sample_count[p];
+        vec3 mean = n > 0 ? state.accum_buffer[p] / n : vec3(0,0,0);
+
+        real an = state.aov.count[p];
+        float* a = &albedo_[3 * p];
+        float* nrm = &normal_[3 * p];
+        float* em = &emission_[3 * p];
+        if (an > 0) {
+            vec3 albedo = state.aov.albedo[p] / an;
+            vec3 emission = state.aov.emission[p] / an;
+            vec3 normal = state.aov.normal[p];
+            real len = normal.length();
+            if (len > 0) normal = normal / len;
+            for (int c = 0; c < 3; ++c) {
+                a[c] = float(albedo[c]);
+                nrm[c] = float(normal[c]);
+                em[c] = float(emission[c]);
+            }
+            depth_[p] = float(state.aov.depth[p] / an);
+        } else {
+            a[0] = a[1] = a[2] = 1.0f;
+            nrm[0] = nrm[1] = nrm[2] = 0.0f;
+            em[0] = em[1] = em[2] = 0.0f;
+            depth_[p] = 0.0f;
+        }
+
+        float* c = &color_[0][3 * p];
+        for (int k = 0; k < 3; ++k)
+            c[k] = std::max(float(mean[k]) - em[k], 0.0f) / std::max(a[k], ALBEDO_EPS);
+
+        // Variance of the pixel mean; one sample says nothing, so assume
+        // the noise is as large as the signal
+        double var = n >= 2 ? double(state.stats.lum_m2[p]) / (double(n) * (n - 1))
+                            : double(luminance(mean)) * luminance(mean);
+        float al = std::max(lum(a), ALBEDO_EPS);
+        var_[0][p] = float(var) / (al * al);
+    }
+
+    // Largest depth change per pixel around (i, j), which the depth stop
+    // scales with tap distance
+    void depth_slope(int i, int j) {
+        auto z = [&](int x, int y) {
+            return depth_[size_t(std::clamp(y, 0, h_ - 1)) * w_ + std::clamp(x, 0, w_ - 1)];
+        };
+        float dx = std::abs(z(i + 1, j) - z(i - 1, j));
+        float dy = std::abs(z(i, j + 1) - z(i, j - 1));
+        slope_[size_t(j) * w_ + i] = 0.5f * std::max(dx, dy);
+    }
+
+    // One a-trous level of row j from buffer src into the other buffer
+    void filter_row(const DenoiseSettings& s, int step, int src, int j) {
+        static constexpr float KERNEL[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+        const float* color = color_[src].data();
+        const float* var = var_[src].data();
+        float* color_out = color_[src ^ 1].data();
+        float* var_out = var_[src ^ 1].data();
+
+        for (int i = 0; i < w_; ++i) {
+            size_t p = size_t(j) * w_ + i;
+            const float* cp = &color[3 * p];
+            const float* np = &normal_[3 * p];
+            // Normals are zero where there is no guide
+            float sharpness = np[0] != 0 || np[1] != 0 || np[2] != 0 ? s.normal_sharpness : 0.0f;
+            float lp = lum(cp);
+            float zp = depth_[p];
+            float inv_l = 1.0f / (s.sigma_color * std::sqrt(std::max(var[p], 0.0f)) + WEIGHT_EPS);
+            // Indexed by the tap's Manhattan distance in steps
+            float inv_z[5];
+            for (int d = 1; d <= 4; ++d)
+                inv_z[d] = 1.0f / (s.sigma_depth * slope_[p] * float(d * step) + 1e-3f * zp +
+                                   WEIGHT_EPS);
+            // Taps inside the image
+            int a0 = std::max(-2, -i / step), a1 = std::min(2, (w_ - 1 - i) / step);
+            int b0 = std::max(-2, -j / step), b1 = std::min(2, (h_ - 1 - j) / step);
+
+            float sum[3] = {0, 0, 0};
+            float sum_w = 0.0f, sum_v = 0.0f;
+            for (int b = b0; b <= b1; ++b) {
+                for (int a = a0; a <= a1; ++a) {
+                    size_t q = p + ptrdiff_t(b * step) * w_ + a * step;
+                    const float* cq = &color[3 * q];
+                    const float* nq = &normal_[3 * q];
+                    float n_dot = np[0] * nq[0] + np[1] * nq[1] + np[2] * nq[2];
+                    // Unguided taps (zero normal) skip the normal stop too
+                    float n_stop = nq[0] != 0 || nq[1] != 0 || nq[2] != 0 ? 1.0f - n_dot : 0.0f;
+                    float e = std::abs(lp - lum(cq)) * inv_l + sharpness * n_stop +
+                              std::abs(zp - depth_[q]) * inv_z[std::abs(a) + std::abs(b)];
+                    // Negligible taps are skipped, which also keeps
+                    // denormals out of the sums; the centre has e = 0
+                    if (e > MAX_EXPONENT) continue;
+                    float w = KERNEL[a + 2] * KERNEL[b + 2] * exp_neg(e);
+                    sum[0] += w * cq[0];
+                    sum[1] += w * cq[1];
+                    sum[2] += w * cq[2];
+                    sum_v += w * w * var[q];
+                    sum_w += w;
+                }
+            }
+            float inv_w = 1.0f / sum_w;
+            for (int k = 0; k < 3; ++k) color_out[3 * p + k] = sum[k] * inv_w;
+            var_out[p] = sum_v * inv_w * inv_w;
+        }
+    }
+
+    int w_ = 0, h_ = 0;
+    std::vector<float> color_[2], var_[2];  // demodulated lighting (rgb), ping-pong
+    std::vector<float> albedo_, normal_, emission_;  // rgb / xyz per pixel
+    std::vector<float> depth_, slope_;
+};
+
+// What the denoiser bought on a run: filter time and, given a reference
+// image, the MSE (mean over pixels of the squared radiance error) before
+// and after. Raw radiance MSE is dominated by the few pixels straddling a
+// light's edge, so it is also measured on values clamped to [0, 1], the
+// range the display shows.
+struct DenoiseReport {
+    double filter_ms = 0.0;
+    bool has_reference = false;
+    double mse_noisy = 0.0, mse_denoised = 0.0;
+    double display_mse_noisy = 0.0, display_mse_denoised = 0.0;
+
+    double mse_removed_per_ms() const {
+        return filter_ms > 0.0 ? (mse_noisy - mse_denoised) / filter_ms : 0.0;
+    }
+};
+
+inline double display_range_mse(const std::vector<vec3>& a, const std::vector<vec3>& b) {
+    double acc = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (int c = 0; c < 3; ++c) {
+            double d = std::clamp(double(a[i][c]), 0.0, 1.0) - std::clamp(double(b[i][c]), 0.0, 1.0);
+            acc += d * d;
+        }
+    }
+    return acc / static_cast<double>(a.size());
+}
+
+// foo.ppm -> foo_denoised.ppm; the accumulation dump has no denoised form,
+// so foo.raw -> foo_denoised.pfm
+inline std::string denoised_path(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + "_denoised.ppm";
+    std::string ext = has_extension(path, ".raw") ? ".pfm" : path.substr(dot);
+    return path.substr(0, dot) + "_denoised" + ext;
+}
+
+// Denoise state's image and write it to path (.pfm: linear, anything else:
+// .ppm through the display transform). With a reference .pfm of the same
+// size, also measure the error before and after. Prints failures.
+inline bool write_denoised_output(const PathTracerState& state, const std::string& path,
+                                  const std::string& reference, DenoiseReport& report) {
+    int W = state.cfg.image_width;
+    int H = state.cfg.image_height;
+    std::vector<vec3> img;
+    Denoiser denoiser;
+    {
+        ProfileScope scope("denoise", "render");
+        report.filter_ms = denoiser.run(state, img, state.scheduler.get());
+    }
+
+    if (!reference.empty()) {
+        std::vector<vec3> ref;
+        int rw = 0, rh = 0;
+        if (!read_pfm(reference, ref, rw, rh) || rw != W || rh != H) {
+            std::cerr << "Cannot use " << reference << " as a " << W << "x" << H
+                      << " reference\n";
+        } else {
+            std::vector<vec3> noisy = normalize_buffer(state);
+            report.has_reference = true;
+            report.mse_noisy = l2_diff(noisy, ref);
+            report.mse_denoised = l2_diff(img, ref);
+            report.display_mse_noisy = display_range_mse(noisy, ref);
+            report.display_mse_denoised = display_range_mse(img, ref);
+        }
+    }
+
+    bool ok = has_extension(path, ".pfm")
+        ? write_pfm(path, img, W, H)
+        : write_ppm(path, img, nullptr, W, H, display_params(state.cfg), state.scheduler.get());
+    if (!ok) std::cerr << "Failed to write " << path << "\n";
+    return ok;
+}
+
+inline void print_denoise_report(const DenoiseReport& r) {
+    std::cout << "Denoised in " << r.filter_ms << " ms";
+    if (r.has_reference)
+        std::cout << ": MSE " << r.mse_noisy << " -> " << r.mse_denoised << " ("
+                  << 100.0 * (1.0 - r.mse_denoised / r.mse_noisy) << "% removed, "
+                  << r.mse_removed_per_ms() << " per ms), display range "
+                  << r.display_mse_noisy << " -> " << r.display_mse_denoised;
+    std::cout << "\n";
+}
@@ -1,22 +1,84 @@
 // hittable.h
 #pragma once
 #include "ray.h"
+#include "aabb.h"
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 
-struct hit_record {
-    vec3 p;
-    vec3 normal;
-    double t;
+template <typename T>
+struct hit_record_t {
+    vec3_t<T> p;
+    vec3_t<T> normal;
+    T t;
     bool front_face;
     int material_id;
+    int light_id;  // of an emissive primitive, else -1
 
-    inline void set_face_normal(const ray& r, const vec3& outward_normal) {
+    inline void set_face_normal(const ray_t<T>& r, const vec3_t<T>& outward_normal) {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
 };
 
-class hittable {
-public:
-    virtual ~hittable() = default;
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+using hit_record = hit_record_t<real>;
+
+// Primitives (sphere, xy_rect, ...) are plain value types with non-virtual
+//   bool hit(const ray&, real t_min, real t_max, hit_record&) const;
+//   bool occludes(const ray&, real t_min, real t_max) const;
+//   bool bounding_box(aabb&) const;
+// and are stored by kind in hittable_list. hit() writes rec only on success;
+// occludes() is the any-hit test used by shadow rays.
+
+// Self-intersection avoidance (Waechter & Binder, "A Fast and Robust Method
+// for Avoiding Self-Intersection", Ray Tracing Gems ch. 6). The hit point is
+// pushed off the surface along n by a fixed number of ULPs, which scales
+// with the magnitude of p, and by a small absolute amount near the origin,
+// where ULPs vanish. Rays spawned this way can use t_min = 0 in either
+// precision instead of a scene-scale epsilon.
+template <typename T> struct ray_offset_traits;
+
+template <> struct ray_offset_traits<float> {
+    using bits = int32_t;
+    static constexpr float origin = 1.0f / 32.0f;
+    static constexpr float float_scale = 1.0f / 65536.0f;
+    static constexpr float int_scale = 256.0f;
+};
+
+template <> struct ray_offset_traits<double> {
+    using bits = int64_t;
+    static constexpr double origin = 1.0 / 32.0;
+    static constexpr double float_scale = 1.0 / 65536.0 / 536870912.0;  // 2^-45
+    static constexpr double int_scale = 256.0;
 };
+
+template <typename T>
+inline T offset_ulps(T x, typename ray_offset_traits<T>::bits ulps) {
+    using bits = typename ray_offset_traits<T>::bits;
+    bits i;
+    std::memcpy(&i, &x, sizeof(T));
+    i += (x < 0) ? -ulps : ulps;
+    std::memcpy(&x, &i, sizeof(T));
+    return x;
+}
+
+template <typename T>
+inline vec3_t<T> offset_ray_origin(const vec3_t<T>& p, const vec3_t<T>& n) {
+    using traits = ray_offset_traits<T>;
+    using bits = typename traits::bits;
+    vec3_t<T> out;
+    for (int a = 0; a < 3; ++a) {
+        bits of = static_cast<bits>(traits::int_scale * n[a]);
+        out[a] = std::fabs(p[a]) < traits::origin
+            ? p[a] + traits::float_scale * n[a]
+            : offset_ulps(p[a], of);
+    }
+    return out;
+}
+
+// Smallest t accepted for rays spawned with offset_ray_origin
+inline constexpr real RAY_T_MIN = 0;
+// Far clip for camera and bounce rays
+inline constexpr real RAY_T_MAX = real(1e9);
+// Shadow rays stop this fraction short of the sampled light point
+inline constexpr real SHADOW_T_SCALE = real(1) - real(1e-4);
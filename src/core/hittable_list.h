@@ -1,31 +1,192 @@
 // hittable_list.h
 #pragma once
 #include "hittable.h"
+#include "bvh.h"
+#include "sphere.h"
+#include "rect.h"
+#include "simd_intersect.h"
+#include "counters.h"
 #include <vector>
-#include <memory>
 
-class hittable_list : public hittable {
+// Leaves are sized to the widest SIMD kernel, which tests them in one pass
+inline constexpr int PRIMITIVE_LEAF_SIZE = SIMD_MAX_WIDTH;
+
+// Intersection-test counter of each primitive kind
+template <typename Prim> struct primitive_test_counter;
+template <> struct primitive_test_counter<sphere>  { static constexpr Counter value = Counter::sphere_tests; };
+template <> struct primitive_test_counter<xy_rect> { static constexpr Counter value = Counter::xy_rect_tests; };
+template <> struct primitive_test_counter<xz_rect> { static constexpr Counter value = Counter::xz_rect_tests; };
+template <> struct primitive_test_counter<yz_rect> { static constexpr Counter value = Counter::yz_rect_tests; };
+
+// Contiguous array of one primitive kind with its own BVH. Building
+// reorders `items` into leaf order, so a leaf is a contiguous slice and the
+// hot path has no indirection, no refcounting and no virtual dispatch.
+template <typename Prim>
+struct primitive_array {
+    std::vector<Prim> items;
+    std::vector<bvh_flat_node> nodes;      // empty: plain linear scan
+    typename soa_layout<Prim>::type soa;   // SIMD copy of items, valid after build()
+    bool soa_ready = false;
+
+    void add(const Prim& p) { items.push_back(p); nodes.clear(); soa_ready = false; }
+    void clear() { items.clear(); nodes.clear(); soa_ready = false; }
+
+    void build() {
+        nodes.clear();
+        if (items.size() > static_cast<size_t>(PRIMITIVE_LEAF_SIZE)) {
+            std::vector<aabb> boxes(items.size());
+            for (size_t i = 0; i < items.size(); ++i)
+                items[i].bounding_box(boxes[i]);
+
+            std::vector<int> order;
+            build_bvh(boxes, nodes, order, PRIMITIVE_LEAF_SIZE);
+
+            std::vector<Prim> sorted(items.size());
+            for (size_t i = 0; i < order.size(); ++i)
+                sorted[i] = items[order[i]];
+            items.swap(sorted);
+        }
+        soa.assign(items);
+        soa_ready = true;
+    }
+
+    // Closest hit in (t_min, closest); shrinks `closest` on success
+    bool hit(const ray& r, real t_min, real& closest, hit_record& rec) const {
+        simd_isa isa = soa_ready ? active_simd_isa() : simd_isa::scalar;
+
+        auto test_range = [&](int first, int count, real& t_max) {
+            count_event(primitive_test_counter<Prim>::value, static_cast<uint64_t>(count));
+            if (isa != simd_isa::scalar && count > 1) {
+                real t;
+                int i = soa.closest(isa, first, count, r, t_min, t_max, t);
+                if (i < 0) return false;
+                if (items[i].hit(r, t_min, t_max, rec)) {
+                    t_max = rec.t;
+                    return true;
+                }
+                // Grazing hit the kernel and hit() round differently; let
+                // the scalar loop below decide
+            }
+
+            bool hit_any = false;
+            for (int i = first; i < first + count; ++i) {
+                if (items[i].hit(r, t_min, t_max, rec)) {
+                    hit_any = true;
+                    t_max = rec.t;
+                }
+            }
+            return hit_any;
+        };
+
+        if (nodes.empty())
+            return test_range(0, static_cast<int>(items.size()), closest);
+
+        real t_max = closest;
+        bool hit_any = traverse_bvh(nodes, r, t_min, t_max,
+            [&](int first, int count, real& t) {
+                if (!test_range(first, count, t)) return false;
+                t_max = t;
+                return true;
+            });
+        if (hit_any) closest = t_max;
+        return hit_any;
+    }
+
+    // True if any item intersects the ray in [t_min, t_max]
+    bool occluded(const ray& r, real t_min, real t_max) const {
+        simd_isa isa = soa_ready ? active_simd_isa() : simd_isa::scalar;
+
+        auto test_range = [&](int first, int count) {
+            count_event(primitive_test_counter<Prim>::value, static_cast<uint64_t>(count));
+            if (isa != simd_isa::scalar && count > 1)
+                return soa.occluded(isa, first, count, r, t_min, t_max);
+            for (int i = first; i < first + count; ++i) {
+                if (items[i].occludes(r, t_min, t_max))
+                    return true;
+            }
+            return false;
+        };
+
+        if (nodes.empty())
+            return test_range(0, static_cast<int>(items.size()));
+        return occluded_bvh(nodes, r, t_min, t_max, test_range);
+    }
+};
+
+// Scene geometry, stored as one typed array per primitive kind. hit() and
+// occluded() walk the kinds' BVHs one after another, passing only the
+// closest hit between them, so overlapping trees are all entered. A shared
+// tree would cull across kinds but mix kinds in its leaves, which the SIMD
+// kernels cannot take; in the box scenes every kind spans the whole room,
+// so there is little to cull.
+class hittable_list {
 public:
-    std::vector<std::shared_ptr<hittable>> objects;
+    primitive_array<sphere>  spheres;
+    primitive_array<xy_rect> xy_rects;
+    primitive_array<xz_rect> xz_rects;
+    primitive_array<yz_rect> yz_rects;
 
     hittable_list() = default;
 
-    void clear() { objects.clear(); }
-    void add(std::shared_ptr<hittable> object) { objects.push_back(object); }
+    void clear() {
+        spheres.clear();
+        xy_rects.clear();
+        xz_rects.clear();
+        yz_rects.clear();
+    }
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override {
-        hit_record temp_rec;
-        bool hit_anything = false;
-        double closest_so_far = t_max;
+    void add(const sphere& s)  { spheres.add(s); }
+    void add(const xy_rect& r) { xy_rects.add(r); }
+    void add(const xz_rect& r) { xz_rects.add(r); }
+    void add(const yz_rect& r) { yz_rects.add(r); }
 
-        for (const auto& object : objects) {
-            if (object->hit(r, t_min, closest_so_far, temp_rec)) {
-                hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
-            }
-        }
+    size_t size() const {
+        return spheres.items.size() + xy_rects.items.size() +
+               xz_rects.items.size() + yz_rects.items.size();
+    }
+
+    // Build a BVH per kind; hit() and occluded() use them until the list
+    // changes
+    void build_acceleration() {
+        spheres.build();
+        xy_rects.build();
+        xz_rects.build();
+        yz_rects.build();
+    }
 
+    bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+        real closest = t_max;
+        bool hit_anything = false;
+        hit_anything |= xz_rects.hit(r, t_min, closest, rec);
+        hit_anything |= yz_rects.hit(r, t_min, closest, rec);
+        hit_anything |= xy_rects.hit(r, t_min, closest, rec);
+        hit_anything |= spheres.hit(r, t_min, closest, rec);
         return hit_anything;
     }
+
+    // Shadow-ray query: does any primitive, emitters included, block the
+    // segment [t_min, t_max]? Stops at the first blocker and builds no
+    // hit_record.
+    bool occluded(const ray& r, real t_min, real t_max) const {
+        return spheres.occluded(r, t_min, t_max) ||
+               xz_rects.occluded(r, t_min, t_max) ||
+               yz_rects.occluded(r, t_min, t_max) ||
+               xy_rects.occluded(r, t_min, t_max);
+    }
+
+    bool bounding_box(aabb& output_box) const {
+        output_box = aabb();
+        aabb temp_box;
+        auto grow_all = [&](const auto& arr) {
+            for (const auto& p : arr.items) {
+                p.bounding_box(temp_box);
+                output_box.grow(temp_box);
+            }
+        };
+        grow_all(spheres);
+        grow_all(xy_rects);
+        grow_all(xz_rects);
+        grow_all(yz_rects);
+        return size() > 0;
+    }
 };
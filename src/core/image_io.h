@@ -0,0 +1,186 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "vec3.h"
+#include "simd_color.h"
+#include "tile_scheduler.h"
+
+// Image output. Writers encode straight into a reused 1 MiB block that is
+// flushed with one fwrite when full, so output time is bounded by encoding
+// and disk bandwidth rather than by per-channel formatted stream writes,
+// and no frame-sized staging copy is allocated.
+//
+//   .ppm  binary P6, 8-bit, encoded from the accumulation buffer with the
+//         display transform of simd_color.h (default: gamma 2.0)
+//   .pfm  float32 linear radiance (HDR), little-endian
+//   .raw  accumulation dump: header, then per pixel float32 radiance sum
+//         (r, g, b) and sample count, for offline merging or inspection
+//
+// Rows are stored top row (j = H-1) first, as the P3 writer always did;
+// PFM is bottom-to-top by definition, so it stores j = 0 first.
+
+static_assert(sizeof(vec3) == 3 * sizeof(real), "vec3 must be tightly packed");
+
+class BlockWriter {
+public:
+    static constexpr size_t BLOCK_BYTES = size_t(1) << 20;
+
+    explicit BlockWriter(const std::string& path)
+        : file_(std::fopen(path.c_str(), "wb")), block_(new char[BLOCK_BYTES]) {
+        ok_ = file_ != nullptr;
+    }
+
+    ~BlockWriter() { close(); }
+
+    BlockWriter(const BlockWriter&) = delete;
+    BlockWriter& operator=(const BlockWriter&) = delete;
+
+    // Space for n more bytes (n <= BLOCK_BYTES), flushing first if needed;
+    // commit(n) after filling it
+    char* reserve(size_t n) {
+        if (used_ + n > BLOCK_BYTES) flush();
+        return block_.get() + used_;
+    }
+    void commit(size_t n) { used_ += n; }
+
+    void write(const void* data, size_t n) {
+        std::memcpy(reserve(n), data, n);
+        commit(n);
+    }
+
+    // Flush and close; true if every byte reached the file
+    bool close() {
+        if (!file_) return false;
+        flush();
+        ok_ = std::fclose(file_) == 0 && ok_;
+        file_ = nullptr;
+        return ok_;
+    }
+
+private:
+    void flush() {
+        if (ok_ && used_ > 0) ok_ = std::fwrite(block_.get(), 1, used_, file_) == used_;
+        used_ = 0;
+    }
+
+    FILE* file_;
+    std::unique_ptr<char[]> block_;
+    size_t used_ = 0;
+    bool ok_;
+};
+
+inline void write_header(BlockWriter& out, const std::string& header) {
+    out.write(header.data(), header.size());
+}
+
+// Pixels below which encoding a block is not worth handing to the pool
+inline constexpr int PARALLEL_ENCODE_MIN_PIXELS = 1 << 15;
+
+// Binary P6 of a W x H accumulation buffer: radiance sums and per pixel
+// sample counts, or means if count is null. Each block is filled in one
+// pass, by pool's workers if a pool is given and the block is large enough.
+inline bool write_ppm(const std::string& path, const std::vector<vec3>& accum,
+                      const real* count, int W, int H,
+                      const DisplayParams& params, TileScheduler* pool = nullptr) {
+    BlockWriter out(path);
+    write_header(out, "P6\n" + std::to_string(W) + " " + std::to_string(H) + "\n255\n");
+    auto encode = [&](size_t first_pixel, int n, uint8_t* dst) {
+        encode_display_rgb8(accum[first_pixel].e, count ? count + first_pixel : nullptr, n,
+                            params, dst);
+    };
+    size_t row_bytes = size_t(W) * 3;
+    if (row_bytes == 0 || H <= 0) return out.close();
+    if (row_bytes > BlockWriter::BLOCK_BYTES) {
+        // Rows wider than a block are encoded in block-sized pieces
+        int piece = static_cast<int>(BlockWriter::BLOCK_BYTES / 3);
+        for (int j = H-1; j >= 0; --j) {
+            for (int x = 0; x < W; x += piece) {
+                int n = std::min(W - x, piece);
+                auto* dst = reinterpret_cast<uint8_t*>(out.reserve(size_t(n) * 3));
+                encode(size_t(j) * W + x, n, dst);
+                out.commit(size_t(n) * 3);
+            }
+        }
+        return out.close();
+    }
+    int rows_per_block = static_cast<int>(BlockWriter::BLOCK_BYTES / row_bytes);
+    for (int top = H; top > 0; top -= rows_per_block) {
+        int rows = std::min(rows_per_block, top);
+        auto* dst = reinterpret_cast<uint8_t*>(out.reserve(rows * row_bytes));
+        parallel_for_ranges(pool, rows, PARALLEL_ENCODE_MIN_PIXELS / std::max(1, W),
+                            [&](int r0, int r1) {
+            for (int r = r0; r < r1; ++r)
+                encode(size_t(top - 1 - r) * W, W, dst + r * row_bytes);
+        });
+        out.commit(rows * row_bytes);
+    }
+    return out.close();
+}
+
+// Converts a run of reals to float32 into the writer
+inline void write_floats(BlockWriter& out, const real* src, size_t count) {
+    constexpr size_t per_block = BlockWriter::BLOCK_BYTES / sizeof(float);
+    for (size_t x = 0; x < count; x += per_block) {
+        size_t n = std::min(count - x, per_block);
+        float* dst = reinterpret_cast<float*>(out.reserve(n * sizeof(float)));
+        for (size_t i = 0; i < n; ++i)
+            dst[i] = static_cast<float>(src[x + i]);
+        out.commit(n * sizeof(float));
+    }
+}
+
+// PFM (float32 RGB, little-endian) of a normalized W x H image
+inline bool write_pfm(const std::string& path, const std::vector<vec3>& img, int W, int H) {
+    BlockWriter out(path);
+    write_header(out, "PF\n" + std::to_string(W) + " " + std::to_string(H) + "\n-1.0\n");
+    write_floats(out, img[0].e, size_t(W) * H * 3);
+    return out.close();
+}
+
+// Read a little-endian PFM written by write_pfm (or any other RGB PFM)
+inline bool read_pfm(const std::string& path, std::vector<vec3>& img, int& W, int& H) {
+    std::unique_ptr<FILE, int (*)(FILE*)> file(std::fopen(path.c_str(), "rb"), std::fclose);
+    if (!file) return false;
+    char magic[3] = {};
+    double scale = 0.0;
+    if (std::fscanf(file.get(), "%2s %d %d %lf", magic, &W, &H, &scale) != 4 ||
+        std::strcmp(magic, "PF") != 0 || W <= 0 || H <= 0 || scale >= 0.0 ||
+        std::fgetc(file.get()) == EOF)  // the single whitespace before the data
+        return false;
+    size_t n = size_t(W) * H * 3;
+    std::vector<float> data(n);
+    if (std::fread(data.data(), sizeof(float), n, file.get()) != n) return false;
+    img.resize(size_t(W) * H);
+    for (size_t i = 0; i < img.size(); ++i)
+        img[i] = vec3(real(data[3 * i]), real(data[3 * i + 1]), real(data[3 * i + 2]));
+    return true;
+}
+
+// Magic of the .raw accumulation dump
+inline constexpr char RAW_ACCUM_MAGIC[8] = {'P', 'T', 'A', 'C', 'C', '1', '\n', '\0'};
+
+// Raw accumulation dump: 8-byte magic, int32 W and H, then W*H records of
+// float32 {sum r, sum g, sum b, sample count}, row j = 0 first
+inline bool write_accum_raw(const std::string& path, const std::vector<vec3>& accum,
+                            const std::vector<real>& count, int W, int H) {
+    BlockWriter out(path);
+    out.write(RAW_ACCUM_MAGIC, sizeof(RAW_ACCUM_MAGIC));
+    int32_t dims[2] = {W, H};
+    out.write(dims, sizeof(dims));
+    for (size_t i = 0; i < size_t(W) * H; ++i) {
+        float rec[4] = {static_cast<float>(accum[i].x()), static_cast<float>(accum[i].y()),
+                        static_cast<float>(accum[i].z()), static_cast<float>(count[i])};
+        out.write(rec, sizeof(rec));
+    }
+    return out.close();
+}
+
+inline bool has_extension(const std::string& path, const char* ext) {
+    size_t n = std::strlen(ext);
+    return path.size() >= n && path.compare(path.size() - n, n, ext) == 0;
+}
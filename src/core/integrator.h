@@ -0,0 +1,207 @@
+#pragma once
+#include "scene_cornell.h"
+#include "material.h"
+#include "counters.h"
+#include "aov.h"
+
+// Shadow ray toward a light sample and the radiance it carries if the light
+// turns out to be visible
+struct ShadowQuery {
+    ray r;
+    real t_max;
+    vec3 contribution;
+};
+
+// Power heuristic (beta = 2): MIS weight of a sample drawn with density
+// pdf_a against a second strategy with density pdf_b
+inline real power_heuristic(real pdf_a, real pdf_b) {
+    real a = pdf_a * pdf_a;
+    real b = pdf_b * pdf_b;
+    return a > 0 ? a / (a + b) : real(0);
+}
+
+// The vertex a path ray left from, which decides how much of the emission
+// it hits is still owed: all of it after the camera or a specular bounce,
+// which NEE cannot sample, else the BSDF strategy's MIS share
+struct PathVertex {
+    vec3 p, normal;  // as NEE saw them when it picked a light
+    vec3 origin;     // offset ray origin the bounce left from
+    real pdf;        // solid-angle density of the bounce direction
+    bool specular;
+};
+
+// One-sample NEE: choose a light (see LightList) and a point on it.
+// Returns false when the sample cannot contribute (no light above the
+// surface, or the point is behind the surface or on the light's back).
+// With mis the contribution carries the light strategy's power-heuristic
+// weight; pass it only when a BSDF bounce may follow to cover the rest.
+inline bool sample_light(const Scene& scene,
+                         const hit_record& rec,
+                         const Material& mat,
+                         const Sampler& sampler,
+                         ShadowQuery& q,
+                         bool mis = false)
+{
+    count_event(Counter::nee_samples);
+    real pick_pmf;
+    int li = scene.lights.pick(rec.p, rec.normal, sampler.get(sample_dim::light_select), pick_pmf);
+    if (li < 0) {
+        count_event(Counter::nee_backfacing);
+        return false;
+    }
+    const Light& L = scene.lights[li];
+    const Material& lm = scene.materials[L.material_id];
+
+    // Sample a point on the light
+    double r1, r2;
+    sampler.get2(sample_dim::light_u, r1, r2);
+    vec3 origin = offset_ray_origin(rec.p, rec.normal);
+    LightSample ls;
+    if (!sample_light_point(L, origin, real(r1), real(r2), ls)) {
+        count_event(Counter::nee_backfacing);
+        return false;
+    }
+
+    real cos_theta = std::max(real(0), dot(rec.normal, ls.wi));
+    if (cos_theta <= 0) {
+        count_event(Counter::nee_backfacing);
+        return false;
+    }
+
+    real pdf = ls.pdf * pick_pmf;
+    real weight = mis ? power_heuristic(pdf, bsdf_pdf(mat, rec.normal, ls.wi)) : real(1);
+    q.r = ray(origin, ls.wi);
+    q.t_max = ls.dist * SHADOW_T_SCALE;
+    q.contribution = eval_bsdf(mat) * lm.emission * (cos_theta * weight / pdf);
+    return true;
+}
+
+// Emission a path collects on hitting an emitter at hit_p along dir, coming
+// from *from (null for camera rays). Without MIS, NEE alone accounts for
+// emitters past a diffuse vertex.
+inline vec3 emission_at_hit(const Scene& scene, const vec3& dir, const vec3& hit_p,
+                            int light_id, const Material& mat, const PathVertex* from) {
+    if (light_id >= 0 && !light_faces(scene.lights[light_id], dir))
+        return vec3(0,0,0);
+    if (!from || from->specular)
+        return mat.emission;
+    if (!scene.lights.mis || light_id < 0)
+        return vec3(0,0,0);
+
+    const Light& L = scene.lights[light_id];
+    vec3 to_light = hit_p - from->origin;
+    real dist = to_light.length();
+    real pdf_light = scene.lights.pick_pmf(from->p, from->normal, light_id) *
+                     light_point_pdf(L, from->origin, to_light / dist, dist);
+    return mat.emission * power_heuristic(from->pdf, pdf_light);
+}
+
+// Trace the shadow ray of a light sample. It stops short of the sample, so
+// anything it meets blocks it, other emitters included: a BSDF ray in that
+// direction would end there too, and MIS needs both strategies to agree on
+// what is visible.
+inline bool light_visible(const Scene& scene, const ShadowQuery& q) {
+    count_event(Counter::shadow_rays);
+    if (scene.world.occluded(q.r, RAY_T_MIN, q.t_max)) {
+        count_event(Counter::nee_occluded);
+        return false;
+    }
+    return true;
+}
+
+// Estimate direct lighting from the scene's lights using one-sample NEE
+inline vec3 sample_direct_light(const Scene& scene,
+                                const hit_record& rec,
+                                const Material& mat,
+                                const Sampler& sampler,
+                                bool mis = false)
+{
+    ShadowQuery q;
+    bool sampled;
+    {
+        StageTimer timer(Stage::shade);
+        sampled = sample_light(scene, rec, mat, sampler, q, mis);
+    }
+    if (!sampled) return vec3(0,0,0);
+
+    StageTimer timer(Stage::shadow);
+    return light_visible(scene, q) ? q.contribution : vec3(0,0,0);
+}
+
+// Survival probability for Russian roulette at the given remaining depth
+inline real russian_roulette_prob(int depth) {
+    return depth < 3 ? real(1) : real(0.9);
+}
+
+// First hit of a camera ray for the AOV buffers
+inline FirstHit first_hit_of(const ray& r, const hit_record& rec, const Material& mat) {
+    FirstHit h;
+    h.albedo = is_emissive(mat) ? vec3(1,1,1) : mat.albedo;
+    h.normal = rec.normal;
+    h.emission = mat.emission;
+    h.depth = rec.t * r.direction().length();
+    return h;
+}
+
+// Recursive path tracer with NEE + RR + BSDF sampling, the two combined
+// by MIS (see LightList::mis). sampler.bounce is the index of the vertex
+// this call shades; it advances on each recursion. The camera vertex
+// (bounce 0) stores its hit in *first if given; later ones get the vertex
+// their ray left from.
+inline vec3 ray_color(const ray& r, const Scene& scene, int depth, Sampler& sampler,
+                      FirstHit* first = nullptr, const PathVertex* from = nullptr) {
+    if (depth <= 0)
+        return vec3(0,0,0);
+
+    count_event(sampler.bounce == 0 ? Counter::camera_rays : Counter::bounce_rays);
+    hit_record rec;
+    bool hit;
+    {
+        StageTimer timer(Stage::intersect);
+        hit = scene.world.hit(r, RAY_T_MIN, RAY_T_MAX, rec);
+    }
+    if (!hit) {
+        count_event(Counter::escaped_paths);
+        return vec3(0,0,0);
+    }
+
+    const Material& mat = scene.materials[rec.material_id];
+    if (first) *first = first_hit_of(r, rec, mat);
+
+    // Lights end the path
+    if (is_emissive(mat)) {
+        count_event(Counter::light_hits);
+        return emission_at_hit(scene, r.direction(), rec.p, rec.light_id, mat, from);
+    }
+
+    // Direct lighting; a mirror's delta lobe leaves nothing for NEE
+    vec3 direct(0,0,0);
+    if (!mat.mirror)
+        direct = sample_direct_light(scene, rec, mat, sampler, scene.lights.mis && depth > 1);
+
+    // Russian roulette, then a bounce drawn from the BSDF
+    real rr_prob = russian_roulette_prob(depth);
+    BsdfSample bs;
+    {
+        StageTimer timer(Stage::scatter);
+        if (sampler.get(sample_dim::roulette) > rr_prob) {
+            count_event(Counter::rr_terminations);
+            return direct;
+        }
+        if (depth - 1 <= 0) {  // no depth left for the bounce
+            count_event(Counter::max_depth_terminations);
+            return direct;
+        }
+        bs = sample_bsdf(mat, r.direction(), rec.normal, sampler);
+    }
+    PathVertex vertex{rec.p, rec.normal, offset_ray_origin(rec.p, rec.normal), bs.pdf, bs.specular};
+    ray scattered(vertex.origin, bs.wi);
+
+    sampler.bounce += 1;
+    vec3 indirect = ray_color(scattered, scene, depth - 1, sampler, nullptr, &vertex);
+
+    // Path throughput update; divide by rr_prob for unbiasedness
+    vec3 bounce = bs.weight * indirect * (1 / rr_prob);
+
+    return direct + bounce;
+}
@@ -0,0 +1,388 @@
+#pragma once
+#include "config.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "bvh.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Light list built from every emissive primitive of the scene, and the two
+// ways of choosing one light per NEE sample:
+//  * power -- an alias table over emitted power: O(1) per pick, but blind
+//             to where the shading point is.
+//  * bvh   -- a light BVH whose nodes store their total power. A pick walks
+//             from the root, choosing each child by power over the squared
+//             distance to its box, and skips boxes entirely below the
+//             shading point's horizon: O(log L) per pick, and nearby lights
+//             are chosen far more often than distant ones.
+// Either way the shadow ray cost does not depend on the number of lights.
+
+// One emissive primitive, in the form light sampling needs
+struct Light {
+    enum Shape { rect, sphere };
+    Shape shape;
+    vec3 p0, u, v;      // rect: corner and edges
+    vec3 normal;        // rect: unit normal of the emitting side
+    bool two_sided;     // rect: emits from both faces
+    vec3 center;        // sphere
+    real radius;
+    real area;
+    real power;         // emitted luminance flux
+    int material_id;
+    aabb box;
+};
+
+// Direction toward a point on a light, as seen from a shading point
+struct LightSample {
+    vec3 wi;     // unit
+    real dist;   // to the light point
+    real pdf;    // solid angle
+};
+
+// Pick a point on L from two uniforms. Returns false if it cannot light
+// origin (back side of a one-sided rect, or origin inside a sphere).
+inline bool sample_light_point(const Light& L, const vec3& origin, real r1, real r2,
+                               LightSample& s)
+{
+    if (L.shape == Light::rect) {
+        vec3 p_light = L.p0 + r1 * L.u + r2 * L.v;
+        vec3 to_light = p_light - origin;
+        real dist2 = to_light.length_squared();
+        s.dist = std::sqrt(dist2);
+        s.wi = to_light / s.dist;
+        real cos_light = -dot(L.normal, s.wi);
+        if (L.two_sided) cos_light = std::fabs(cos_light);
+        if (cos_light <= 0) return false;
+        s.pdf = dist2 / (L.area * cos_light);
+        return s.pdf > 0;
+    }
+
+    // Sphere: uniform over the cone of directions it subtends
+    vec3 to_center = L.center - origin;
+    real d2 = to_center.length_squared();
+    real r2_sphere = L.radius * L.radius;
+    if (d2 <= r2_sphere) return false;
+    real d = std::sqrt(d2);
+    real sin2_max = r2_sphere / d2;
+    real cos_max = std::sqrt(std::max(real(0), 1 - sin2_max));
+    real one_minus_cos_max = sin2_max / (1 + cos_max);  // no cancellation
+
+    real cos_theta = 1 - r1 * one_minus_cos_max;
+    real sin_theta = std::sqrt(std::max(real(0), 1 - cos_theta * cos_theta));
+    real phi = 2 * PI_MAT * r2;
+    onb basis;
+    basis.build_from_w(to_center / d);
+    s.wi = unit_vector(basis.local(std::cos(phi) * sin_theta, std::sin(phi) * sin_theta,
+                                   cos_theta));
+    // Near intersection along wi
+    real h2 = std::max(real(0), r2_sphere - d2 * sin_theta * sin_theta);
+    s.dist = d * cos_theta - std::sqrt(h2);
+    s.pdf = 1 / (2 * PI_MAT * one_minus_cos_max);
+    return s.dist > 0;
+}
+
+// True if a ray travelling along dir sees L's emitting side; one-sided
+// rects are dark from behind
+inline bool light_faces(const Light& L, const vec3& dir) {
+    return L.shape == Light::sphere || L.two_sided || dot(L.normal, dir) < 0;
+}
+
+// Solid-angle density with which sample_light_point, called from origin,
+// yields the point at distance dist along wi (a point on L)
+inline real light_point_pdf(const Light& L, const vec3& origin, const vec3& wi, real dist) {
+    if (L.shape == Light::rect) {
+        real cos_light = -dot(L.normal, wi);
+        if (L.two_sided) cos_light = std::fabs(cos_light);
+        if (cos_light <= 0) return 0;
+        return dist * dist / (L.area * cos_light);
+    }
+    real d2 = (L.center - origin).length_squared();
+    real r2_sphere = L.radius * L.radius;
+    if (d2 <= r2_sphere) return 0;
+    real sin2_max = r2_sphere / d2;
+    real cos_max = std::sqrt(std::max(real(0), 1 - sin2_max));
+    return 1 / (2 * PI_MAT * (sin2_max / (1 + cos_max)));
+}
+
+// Walker's alias method (Vose's construction): O(1) sampling of a discrete
+// distribution
+class AliasTable {
+public:
+    void build(const std::vector<double>& weights) {
+        size_t n = weights.size();
+        prob_.assign(n, 1.0);
+        alias_.resize(n);
+        pmf_.assign(n, 0.0);
+        double total = 0.0;
+        for (double w : weights) total += w;
+        if (n == 0 || total <= 0.0) {
+            for (size_t i = 0; i < n; ++i) pmf_[i] = 1.0 / n;  // uniform fallback
+        } else {
+            for (size_t i = 0; i < n; ++i) pmf_[i] = weights[i] / total;
+        }
+
+        std::vector<double> scaled(n);
+        std::vector<int> small, large;
+        for (size_t i = 0; i < n; ++i) {
+            alias_[i] = static_cast<int>(i);
+            scaled[i] = pmf_[i] * n;
+            (scaled[i] < 1.0 ? small : large).push_back(static_cast<int>(i));
+        }
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(), l = large.back();
+            small.pop_back();
+            prob_[s] = scaled[s];
+            alias_[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // What is left is 1 up to rounding
+        for (int i : small) prob_[i] = 1.0;
+        for (int i : large) prob_[i] = 1.0;
+    }
+
+    bool empty() const { return pmf_.empty(); }
+    double pmf(int i) const { return pmf_[i]; }
+
+    // Index for a uniform u in [0, 1)
+    int sample(double u) const {
+        double x = u * prob_.size();
+        int i = std::min(static_cast<int>(x), static_cast<int>(prob_.size()) - 1);
+        return x - i < prob_[i] ? i : alias_[i];
+    }
+
+private:
+    std::vector<double> prob_;   // chance of keeping bucket i
+    std::vector<int> alias_;     // taken otherwise
+    std::vector<double> pmf_;
+};
+
+// In-plane extent of a rect: its first axis, then its second
+inline void rect_extent(const xy_rect& r, real& lo_a, real& hi_a, real& lo_b, real& hi_b) {
+    lo_a = r.x0; hi_a = r.x1; lo_b = r.y0; hi_b = r.y1;
+}
+inline void rect_extent(const xz_rect& r, real& lo_a, real& hi_a, real& lo_b, real& hi_b) {
+    lo_a = r.x0; hi_a = r.x1; lo_b = r.z0; hi_b = r.z1;
+}
+inline void rect_extent(const yz_rect& r, real& lo_a, real& hi_a, real& lo_b, real& hi_b) {
+    lo_a = r.y0; hi_a = r.y1; lo_b = r.z0; hi_b = r.z1;
+}
+
+class LightList {
+public:
+    LightSampling strategy = LightSampling::bvh;
+    bool mis = true;  // weigh NEE against BSDF hits on lights; off: NEE alone
+
+    bool empty() const { return lights_.empty(); }
+    size_t size() const { return lights_.size(); }
+    const Light& operator[](int i) const { return lights_[i]; }
+
+    // Collect the lights of world, whose primitives with an emissive
+    // material are emitters, and build both samplers. Each emitter's
+    // light_id is set to its index here, so a path that hits it can look
+    // up its pdf.
+    void build(hittable_list& world, const std::vector<Material>& materials) {
+        lights_.clear();
+        std::vector<int*> owner;  // per light: its primitive's light_id
+        auto emissive = [&](int m) {
+            return m >= 0 && m < static_cast<int>(materials.size()) && is_emissive(materials[m]);
+        };
+        // axis: the rect's normal axis; a and b its two in-plane axes
+        auto add_rects = [&](auto& arr, int axis, int a, int b) {
+            for (auto& r : arr.items) {
+                if (!emissive(r.material_id)) continue;
+                real lo_a, hi_a, lo_b, hi_b;
+                rect_extent(r, lo_a, hi_a, lo_b, hi_b);
+                Light L;
+                L.shape = Light::rect;
+                L.p0[axis] = r.k;
+                L.p0[a] = lo_a;
+                L.p0[b] = lo_b;
+                L.u = vec3(0,0,0);
+                L.u[a] = hi_a - lo_a;
+                L.v = vec3(0,0,0);
+                L.v[b] = hi_b - lo_b;
+                L.normal = vec3(0,0,0);
+                L.normal[axis] = r.facing < 0 ? -1 : 1;
+                L.two_sided = r.facing == 0;
+                L.area = cross(L.u, L.v).length();
+                L.power = luminance(materials[r.material_id].emission) * L.area * PI_MAT *
+                          (L.two_sided ? 2 : 1);
+                L.material_id = r.material_id;
+                r.bounding_box(L.box);
+                lights_.push_back(L);
+                owner.push_back(&r.light_id);
+            }
+        };
+        add_rects(world.xz_rects, 1, 0, 2);
+        add_rects(world.yz_rects, 0, 1, 2);
+        add_rects(world.xy_rects, 2, 0, 1);
+        for (sphere& s : world.spheres.items) {
+            if (!emissive(s.material_id)) continue;
+            Light L;
+            L.shape = Light::sphere;
+            L.center = s.center;
+            L.radius = s.radius;
+            L.area = 4 * PI_MAT * s.radius * s.radius;
+            L.power = luminance(materials[s.material_id].emission) * L.area * PI_MAT;
+            L.material_id = s.material_id;
+            s.bounding_box(L.box);
+            lights_.push_back(L);
+            owner.push_back(&s.light_id);
+        }
+        build_bvh_sampler(owner);
+        for (size_t i = 0; i < lights_.size(); ++i) *owner[i] = static_cast<int>(i);
+
+        std::vector<double> power(lights_.size());
+        for (size_t i = 0; i < lights_.size(); ++i) power[i] = lights_[i].power;
+        alias_.build(power);
+    }
+
+    // Choose a light for shading point p with normal n from u in [0, 1).
+    // Returns its index and sets pmf to the chance of choosing it, or
+    // returns -1 when no light can reach p.
+    int pick(const vec3& p, const vec3& n, double u, real& pmf) const {
+        if (lights_.empty()) return -1;
+        if (strategy == LightSampling::power) {
+            int i = alias_.sample(u);
+            pmf = real(alias_.pmf(i));
+            return i;
+        }
+
+        double prob = 1.0;
+        int node = 0;
+        while (nodes_[node].count == 0) {
+            int left = node + 1, right = nodes_[node].offset;
+            double pl;
+            if (!left_probability(left, right, p, n, pl)) return -1;
+            if (u < pl) {
+                u = u / pl;
+                prob *= pl;
+                node = left;
+            } else {
+                u = (u - pl) / (1.0 - pl);
+                prob *= 1.0 - pl;
+                node = right;
+            }
+            u = std::min(u, 1.0 - 1e-12);
+        }
+
+        // Lights sharing a leaf by power
+        const bvh_flat_node& leaf = nodes_[node];
+        int i = leaf.offset;
+        if (leaf.count > 1) {
+            double target = u * info_[node].power;
+            for (int end = leaf.offset + leaf.count - 1; i < end; ++i) {
+                target -= lights_[i].power;
+                if (target < 0.0) break;
+            }
+            prob *= lights_[i].power / info_[node].power;
+        }
+        pmf = real(prob);
+        return i;
+    }
+
+    // Chance that pick() at (p, n) returns light i
+    real pick_pmf(const vec3& p, const vec3& n, int i) const {
+        if (strategy == LightSampling::power) return real(alias_.pmf(i));
+
+        int node = leaf_of_[i];
+        double prob = nodes_[node].count > 1 ? lights_[i].power / info_[node].power : 1.0;
+        for (int parent = parent_[node]; parent >= 0; node = parent, parent = parent_[node]) {
+            int left = parent + 1, right = nodes_[parent].offset;
+            double pl;
+            if (!left_probability(left, right, p, n, pl)) return 0;
+            prob *= node == left ? pl : 1.0 - pl;
+        }
+        return real(prob);
+    }
+
+private:
+    // Build the light BVH; lights_ (and owner with it) is reordered into
+    // leaf order
+    void build_bvh_sampler(std::vector<int*>& owner) {
+        nodes_.clear();
+        info_.clear();
+        parent_.clear();
+        leaf_of_.clear();
+        if (lights_.empty()) return;
+
+        std::vector<aabb> boxes(lights_.size());
+        for (size_t i = 0; i < lights_.size(); ++i) boxes[i] = lights_[i].box;
+        std::vector<int> order;
+        build_bvh(boxes, nodes_, order, 1);
+        std::vector<Light> sorted(lights_.size());
+        std::vector<int*> sorted_owner(lights_.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            sorted[i] = lights_[order[i]];
+            sorted_owner[i] = owner[order[i]];
+        }
+        lights_.swap(sorted);
+        owner.swap(sorted_owner);
+
+        // Children follow their parent, so a reverse sweep sums bottom-up
+        info_.resize(nodes_.size());
+        parent_.assign(nodes_.size(), -1);
+        leaf_of_.assign(lights_.size(), 0);
+        for (int k = static_cast<int>(nodes_.size()) - 1; k >= 0; --k) {
+            const bvh_flat_node& node = nodes_[k];
+            info_[k].center = node.box.centroid();
+            info_[k].radius2 = 0.25 * (node.box.maximum - node.box.minimum).length_squared();
+            info_[k].power = 0.0;
+            if (node.count > 0) {
+                for (int i = node.offset; i < node.offset + node.count; ++i) {
+                    info_[k].power += lights_[i].power;
+                    leaf_of_[i] = k;
+                }
+            } else {
+                info_[k].power = info_[k + 1].power + info_[node.offset].power;
+                parent_[k + 1] = k;
+                parent_[node.offset] = k;
+            }
+        }
+    }
+
+    // What node k's lights are worth to shading point p with normal n:
+    // power over squared distance (at least the box's squared half
+    // diagonal). Returned as that fraction, 0 if the whole box is below p's
+    // horizon.
+    void importance(int k, const vec3& p, const vec3& n, double& power, double& d2) const {
+        const aabb& box = nodes_[k].box;
+        const NodeInfo& info = info_[k];
+        // Highest point of the box over p's tangent plane, axis by axis
+        double height = 0.0;
+        for (int a = 0; a < 3; ++a)
+            height += std::max(n[a] * (box.minimum[a] - p[a]), n[a] * (box.maximum[a] - p[a]));
+        power = height > 0.0 ? info.power : 0.0;
+        d2 = std::max(double((info.center - p).length_squared()), info.radius2);
+    }
+
+    // Chance of descending into the left of two siblings; false if neither
+    // can light p
+    bool left_probability(int left, int right, const vec3& p, const vec3& n, double& pl) const {
+        double power_l, d2_l, power_r, d2_r;
+        importance(left, p, n, power_l, d2_l);
+        importance(right, p, n, power_r, d2_r);
+        double wl = power_l * d2_r, wr = power_r * d2_l;  // importances times d2_l * d2_r
+        if (wl + wr <= 0.0) return false;
+        pl = wl / (wl + wr);
+        return true;
+    }
+
+    struct NodeInfo {
+        vec3 center;     // of the node's box
+        double radius2;  // squared half diagonal of the box
+        double power;    // total power of the node's lights
+    };
+
+    std::vector<Light> lights_;
+    AliasTable alias_;
+    std::vector<bvh_flat_node> nodes_;
+    std::vector<NodeInfo> info_;       // per node
+    std::vector<int> parent_;          // per node, -1 at the root
+    std::vector<int> leaf_of_;         // per light
+};
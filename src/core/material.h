@@ -2,9 +2,10 @@
 #include "ray.h"
 #include "vec3.h"
 #include "hittable.h"
+#include <algorithm>
 #include <cmath>
 
-inline constexpr double PI_MAT = 3.14159265358979323846;
+inline constexpr real PI_MAT = real(3.14159265358979323846);
 
 struct Material {
     vec3 albedo;
@@ -17,7 +18,7 @@ struct Material {
 };
 
 inline bool is_emissive(const Material& m) {
-    return m.emission.length_squared() > 0.0;
+    return m.emission.length_squared() > 0;
 }
 
 // Orthonormal basis for cosine sampling
@@ -31,26 +32,86 @@ struct onb {
         u = cross(v, w);
     }
 
-    vec3 local(double a, double b, double c) const {
+    vec3 local(real a, real b, real c) const {
         return a*u + b*v + c*w;
     }
 };
 
-// Cosine-weighted hemisphere direction in local coords
+// Cosine-weighted hemisphere direction in local coords from two uniforms
+inline vec3 random_cosine_direction(real r1, real r2) {
+    real z = std::sqrt(1 - r2);
+    real phi = 2 * PI_MAT * r1;
+    real x = std::cos(phi) * std::sqrt(r2);
+    real y = std::sin(phi) * std::sqrt(r2);
+    return vec3(x, y, z);
+}
+
 inline vec3 random_cosine_direction() {
     double r1 = random_double();
     double r2 = random_double();
-    double z = std::sqrt(1.0 - r2);
-    double phi = 2.0 * PI_MAT * r1;
-    double x = std::cos(phi) * std::sqrt(r2);
-    double y = std::sin(phi) * std::sqrt(r2);
-    return vec3(x, y, z);
+    return random_cosine_direction(r1, r2);
 }
 
 // Sample diffuse direction around surface normal (cosine-weighted)
-inline vec3 sample_diffuse_direction(const vec3& normal) {
+inline vec3 sample_diffuse_direction(const vec3& normal, real r1, real r2) {
     onb basis;
     basis.build_from_w(normal);
-    vec3 d = random_cosine_direction();
+    vec3 d = random_cosine_direction(r1, r2);
     return basis.local(d.x(), d.y(), d.z());
 }
+
+inline vec3 sample_diffuse_direction(const vec3& normal) {
+    double r1 = random_double();
+    double r2 = random_double();
+    return sample_diffuse_direction(normal, r1, r2);
+}
+
+// Cosine-weighted bounce using the BSDF dimensions of the path's sampler
+inline vec3 sample_diffuse_direction(const vec3& normal, const Sampler& sampler) {
+    double r1, r2;
+    sampler.get2(sample_dim::bsdf_u, r1, r2);
+    return sample_diffuse_direction(normal, r1, r2);
+}
+
+// BSDF of a material: Lambertian with its albedo or, for a mirror, perfect
+// specular reflection with the albedo as reflectance. The mirror's lobe is
+// a delta: it can be sampled but has no density, so light sampling never
+// reaches it.
+
+// Direction drawn from a material's BSDF
+struct BsdfSample {
+    vec3 wi;
+    vec3 weight;    // f * cos / pdf
+    real pdf;       // solid angle; 0 for a specular bounce
+    bool specular;
+};
+
+// f of a non-mirror material (Lambertian)
+inline vec3 eval_bsdf(const Material& m) {
+    return m.mirror ? vec3(0,0,0) : m.albedo / PI_MAT;
+}
+
+// Solid-angle density with which sample_bsdf picks wi; 0 for a mirror
+inline real bsdf_pdf(const Material& m, const vec3& normal, const vec3& wi) {
+    if (m.mirror) return 0;
+    return std::max(real(0), dot(normal, wi)) / PI_MAT;
+}
+
+// Continue a path that arrived along dir at a surface with normal (facing
+// back along dir)
+inline BsdfSample sample_bsdf(const Material& m, const vec3& dir, const vec3& normal,
+                              const Sampler& sampler) {
+    BsdfSample s;
+    if (m.mirror) {
+        s.wi = reflect(unit_vector(dir), normal);
+        s.weight = m.albedo;
+        s.pdf = 0;
+        s.specular = true;
+        return s;
+    }
+    s.wi = sample_diffuse_direction(normal, sampler);
+    s.weight = m.albedo;  // cosine sampling: f * cos / pdf
+    s.pdf = bsdf_pdf(m, normal, s.wi);
+    s.specular = false;
+    return s;
+}
@@ -1,6 +1,13 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <vector>
 #include "vec3.h"
+#include "aov.h"
+#include "simd.h"
+#include "simd_stats.h"
+#include "tile_scheduler.h"
 
 inline double l2_diff(const std::vector<vec3>& a,
                       const std::vector<vec3>& b)
@@ -13,3 +20,150 @@ inline double l2_diff(const std::vector<vec3>& a,
     }
     return acc / static_cast<double>(n);
 }
+
+// Keeps relMSE finite on black pixels
+inline constexpr real REL_MSE_EPS = real(1e-2);
+
+// Samples of one pixel taken in the current pass, with their own Welford
+// luminance mean/M2 so they can be merged without being stored, and the
+// sum of their first hits
+struct SampleBatch {
+    vec3 sum;
+    real n = 0, mean = 0, m2 = 0;
+    FirstHit first_hits;
+
+    void add(const vec3& c, const FirstHit& hit) {
+        first_hits.albedo += hit.albedo;
+        first_hits.normal += hit.normal;
+        first_hits.emission += hit.emission;
+        first_hits.depth += hit.depth;
+        sum += c;
+        n += 1;
+        real l = luminance(c);
+        real delta = l - mean;
+        mean += delta / n;
+        m2 += delta * (l - mean);
+    }
+};
+
+// Running convergence statistics kept alongside accum_buffer. Per pixel:
+// the sample count and a Welford mean/M2 of sample luminance, stored as
+// separate arrays (padded for full-width SIMD loads) so per-tile
+// reductions can stream them. Per tile: the residual and relMSE sums of
+// the latest pass, written by the worker that rendered the tile.
+//
+// The residual is the same quantity l2_diff reports between consecutive
+// normalized frames, but computed per pixel from the change in its mean,
+// so no frame copy is needed.
+struct ConvergenceStats {
+    std::vector<real> sample_count, lum_mean, lum_m2;
+    std::vector<double> tile_residual, tile_rel_mse;
+    double residual = 0.0;  // mean over pixels of |mean_new - mean_old|^2
+    double rel_mse = 0.0;   // mean over pixels of Var[mean] / (mean^2 + eps)
+
+    // Mean pixel relMSE over the tiles being sampled this pass; pixels get
+    // samples in proportion to their error relative to it. 0 = uniform.
+    double budget_error = 0.0;
+
+    // Drivers whose counts lag behind the samples in flight (asynchronous
+    // MPI aggregation) number samples by pass instead: when >= 0, every
+    // pixel's samples this pass start at this index
+    int64_t pass_sample_base = -1;
+
+    void reset(int pixels, int tiles) {
+        size_t n = static_cast<size_t>(pixels) + SIMD_MAX_WIDTH;
+        sample_count.assign(n, real(0));
+        lum_mean.assign(n, real(0));
+        lum_m2.assign(n, real(0));
+        tile_residual.assign(tiles, 0.0);
+        tile_rel_mse.assign(tiles, 0.0);
+        residual = rel_mse = 0.0;
+    }
+
+    // Merge one pass worth of samples of pixel idx into accum and the
+    // running statistics (Chan et al. pairwise update). Returns the squared
+    // change of the pixel's mean radiance.
+    double merge(std::vector<vec3>& accum, int idx, const SampleBatch& b) {
+        if (b.n == 0) return 0.0;
+        real na = sample_count[idx];
+        vec3 old_mean = na > 0 ? accum[idx] / na : vec3(0,0,0);
+        real n = na + b.n;
+        real delta = b.mean - lum_mean[idx];
+        lum_mean[idx] += delta * (b.n / n);
+        lum_m2[idx] += b.m2 + delta * delta * (na * b.n / n);
+        sample_count[idx] = n;
+        accum[idx] += b.sum;
+        return static_cast<double>((accum[idx] / n - old_mean).length_squared());
+    }
+
+    // Sampler index of pixel idx's first sample this pass
+    uint32_t first_sample(int idx) const {
+        return pass_sample_base >= 0 ? static_cast<uint32_t>(pass_sample_base)
+                                     : static_cast<uint32_t>(sample_count[idx]);
+    }
+
+    // Estimated relMSE of pixel idx, or -1 with fewer than two samples
+    double pixel_rel_mse(int idx) const {
+        real n = sample_count[idx];
+        if (n < 2) return -1.0;
+        double var_mean = double(lum_m2[idx]) / (double(n) * (n - 1));
+        return var_mean / (double(lum_mean[idx]) * lum_mean[idx] + REL_MSE_EPS);
+    }
+
+    // Samples pixel idx takes this pass: spp when sampling uniformly,
+    // otherwise spp scaled by the pixel's share of the error, in [1, max_spp]
+    int sample_budget(int idx, int spp, int max_spp) const {
+        if (budget_error <= 0.0) return spp;
+        double e = pixel_rel_mse(idx);
+        if (e < 0.0) return spp;
+        double k = std::ceil(spp * e / budget_error);
+        return static_cast<int>(std::clamp(k, 1.0, static_cast<double>(max_spp)));
+    }
+
+    // Total samples a uniform sampler would need to reach the current
+    // rel_mse: with per-sample relative variance s_p, uniform n per pixel
+    // gives rel_mse = sum(s_p) / (P n), so P n = sum(s_p) / rel_mse
+    double uniform_samples_for_same_error(int pixels) const {
+        if (rel_mse <= 0.0) return 0.0;
+        double s = 0.0;
+        for (int i = 0; i < pixels; ++i) {
+            double e = pixel_rel_mse(i);
+            if (e > 0.0) s += e * sample_count[i];
+        }
+        return s / rel_mse;
+    }
+
+    double total_samples(int pixels) const {
+        double n = 0.0;
+        for (int i = 0; i < pixels; ++i) n += sample_count[i];
+        return n;
+    }
+
+    // For drivers that fill accum_buffer themselves: every pixel has n
+    // samples (no variance is tracked)
+    void set_uniform_count(real n) {
+        std::fill(sample_count.begin(), sample_count.end(), n);
+    }
+
+    // relMSE sum over the pixels of a tile of a W-wide image
+    double tile_rel_mse_sum(int W, const Tile& tile) const {
+        double acc = 0.0;
+        for (int j = tile.y0; j < tile.y1; ++j) {
+            int row = j * W + tile.x0;
+            acc += rel_mse_sum(&lum_mean[row], &lum_m2[row], &sample_count[row],
+                               tile.x1 - tile.x0, REL_MSE_EPS);
+        }
+        return acc;
+    }
+
+    // Fold the per-tile sums into the global figures
+    void reduce(int pixels) {
+        double res = 0.0, rel = 0.0;
+        for (size_t t = 0; t < tile_residual.size(); ++t) {
+            res += tile_residual[t];
+            rel += tile_rel_mse[t];
+        }
+        residual = res / pixels;
+        rel_mse = rel / pixels;
+    }
+};
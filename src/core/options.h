@@ -0,0 +1,169 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "path_tracer.h"
+#include "simd.h"
+
+// Command-line options shared by the drivers:
+//   <prog> [iterations] [--threads N] [--tile N] [--simd ISA]
+//          [--engine megakernel|wavefront] [--seed N] [--spp N]
+//          [--scene cornell|ceiling-grid|cornell-mirror]
+//          [--light-sampling power|bvh] [--direct nee|mis]
+//          [--adaptive THRESHOLD] [--max-spp N] [--output FILE.ppm|.pfm|.raw]
+//          [--checkpoint FILE] [--checkpoint-every N] [--resume]
+//          [--profile FILE.json] [--exposure STOPS]
+//          [--tonemap clamp|reinhard|aces] [--encoding gamma2|srgb]
+//          [--denoise] [--reference FILE.pfm]
+//          [--mpi-decomp image|samples] [--mpi-schedule dynamic|static]
+//          [--mpi-sync N]   (MPI driver only)
+struct RunOptions {
+    int max_iterations = 0;     // the driver sets its default before parsing
+    std::string output;         // empty: the driver's default file name
+    std::string checkpoint;     // empty: no checkpoints
+    int checkpoint_every = 16;  // passes between checkpoints
+    bool resume = false;        // continue from the checkpoint file
+    std::string profile;        // empty: no timeline profile
+    bool denoise = false;       // also write a denoised image (see denoise.h)
+    std::string reference;      // .pfm the denoiser's error is measured against
+    bool mpi_samples = false;   // every rank traces the whole frame, disjoint samples
+    bool mpi_static = false;    // fixed tile share per rank instead of a shared queue
+    int mpi_sync_interval = 1;  // passes between framebuffer reductions
+};
+
+inline void print_usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [iterations]"
+              << " [--threads N] [--tile N]"
+              << " [--simd scalar|sse4|avx2|avx512]"
+              << " [--engine megakernel|wavefront] [--seed N] [--spp N]"
+              << " [--scene cornell|ceiling-grid|cornell-mirror]"
+              << " [--light-sampling power|bvh] [--direct nee|mis]"
+              << " [--adaptive THRESHOLD] [--max-spp N] [--output FILE.ppm|.pfm|.raw]"
+              << " [--checkpoint FILE] [--checkpoint-every N] [--resume]"
+              << " [--profile FILE.json] [--exposure STOPS]"
+              << " [--tonemap clamp|reinhard|aces] [--encoding gamma2|srgb]"
+              << " [--denoise] [--reference FILE.pfm]"
+              << " [--mpi-decomp image|samples] [--mpi-schedule dynamic|static]"
+              << " [--mpi-sync N]\n";
+}
+
+// Parses argv into opt and cfg. Returns false (after printing usage) on
+// malformed input.
+inline bool parse_options(int argc, char** argv, RunOptions& opt, PathTracerConfig& cfg) {
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        auto next_int = [&](int& dst) {
+            if (a + 1 >= argc) return false;
+            dst = std::atoi(argv[++a]);
+            return true;
+        };
+
+        bool ok = true;
+        if (arg == "--threads") {
+            ok = next_int(cfg.num_threads);
+        } else if (arg == "--tile") {
+            ok = next_int(cfg.tile_size) && cfg.tile_size > 0;
+        } else if (arg == "--simd") {
+            simd_isa isa;
+            ok = a + 1 < argc && parse_simd_isa(argv[++a], isa);
+            if (ok) set_simd_isa(isa);
+        } else if (arg == "--seed") {
+            int seed = 0;
+            ok = next_int(seed);
+            cfg.seed = static_cast<uint32_t>(seed);
+        } else if (arg == "--spp") {
+            ok = next_int(cfg.spp_per_iteration) && cfg.spp_per_iteration > 0;
+        } else if (arg == "--adaptive") {
+            ok = a + 1 < argc;
+            if (ok) cfg.adaptive_threshold = std::atof(argv[++a]);
+            cfg.adaptive = ok && cfg.adaptive_threshold > 0.0;
+            ok = cfg.adaptive;
+        } else if (arg == "--max-spp") {
+            ok = next_int(cfg.adaptive_max_spp) && cfg.adaptive_max_spp > 0;
+        } else if (arg == "--engine") {
+            std::string name = a + 1 < argc ? argv[++a] : "";
+            if (name == "megakernel") cfg.engine = RenderEngine::megakernel;
+            else if (name == "wavefront") cfg.engine = RenderEngine::wavefront;
+            else ok = false;
+        } else if (arg == "--scene") {
+            std::string name = a + 1 < argc ? argv[++a] : "";
+            if (name == "cornell") cfg.scene = SceneKind::cornell;
+            else if (name == "ceiling-grid") cfg.scene = SceneKind::ceiling_grid;
+            else if (name == "cornell-mirror") cfg.scene = SceneKind::cornell_mirror;
+            else ok = false;
+        } else if (arg == "--light-sampling") {
+            std::string name = a + 1 < argc ? argv[++a] : "";
+            if (name == "power") cfg.light_sampling = LightSampling::power;
+            else if (name == "bvh") cfg.light_sampling = LightSampling::bvh;
+            else ok = false;
+        } else if (arg == "--direct") {
+            std::string name = a + 1 < argc ? argv[++a] : "";
+            if (name == "nee") cfg.direct_lighting = DirectLighting::nee;
+            else if (name == "mis") cfg.direct_lighting = DirectLighting::mis;
+            else ok = false;
+        } else if (arg == "--output") {
+            ok = a + 1 < argc;
+            if (ok) opt.output = argv[++a];
+        } else if (arg == "--checkpoint") {
+            ok = a + 1 < argc;
+            if (ok) opt.checkpoint = argv[++a];
+        } else if (arg == "--checkpoint-every") {
+            ok = next_int(opt.checkpoint_every) && opt.checkpoint_every > 0;
+        } else if (arg == "--resume") {
+            opt.resume = true;
+        } else if (arg == "--profile") {
+            ok = a + 1 < argc;
+            if (ok) opt.profile = argv[++a];
+        } else if (arg == "--exposure") {
+            ok = a + 1 < argc;
+            if (ok) cfg.exposure = std::atof(argv[++a]);
+        } else if (arg == "--tonemap") {
+            std::string name = a + 1 < argc ? argv[++a] : "";
+            if (name == "clamp") cfg.tonemap = Tonemap::clamp;
+            else if (name == "reinhard") cfg.tonemap = Tonemap::reinhard;
+            else if (name == "aces") cfg.tonemap = Tonemap::aces;
+            else ok = false;
+        } else if (arg == "--encoding") {
+            std::string name = a + 1 < argc ? argv[++a] : "";
+            if (name == "gamma2") cfg.encoding = DisplayEncoding::gamma2;
+            else if (name == "srgb") cfg.encoding = DisplayEncoding::srgb;
+            else ok = false;
+        } else if (arg == "--denoise") {
+            opt.denoise = true;
+        } else if (arg == "--reference") {
+            ok = a + 1 < argc;
+            if (ok) opt.reference = argv[++a];
+        } else if (arg == "--mpi-decomp") {
+            std::string name = a + 1 < argc ? argv[++a] : "";
+            if (name == "image") opt.mpi_samples = false;
+            else if (name == "samples") opt.mpi_samples = true;
+            else ok = false;
+        } else if (arg == "--mpi-schedule") {
+            std::string name = a + 1 < argc ? argv[++a] : "";
+            if (name == "dynamic") opt.mpi_static = false;
+            else if (name == "static") opt.mpi_static = true;
+            else ok = false;
+        } else if (arg == "--mpi-sync") {
+            ok = next_int(opt.mpi_sync_interval) && opt.mpi_sync_interval > 0;
+        } else if (!arg.empty() && arg[0] != '-') {
+            opt.max_iterations = std::atoi(arg.c_str());
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if (!opt.reference.empty() && !opt.denoise) {
+        std::cerr << "--reference needs --denoise\n";
+        return false;
+    }
+    if (opt.resume && opt.checkpoint.empty()) {
+        std::cerr << "--resume needs --checkpoint FILE\n";
+        return false;
+    }
+    return true;
+}
@@ -1,63 +1,34 @@
 #pragma once
+#include "config.h"
 #include "scene_cornell.h"
 #include "camera.h"
 #include "color.h"
+#include "image_io.h"
 #include "metrics.h"
 #include "material.h"
-
-// Estimate direct lighting from the area light using one-sample NEE
-inline vec3 sample_direct_light(const Scene& scene,
-                                const hit_record& rec,
-                                const Material& mat)
-{
-    const AreaLight& L = scene.light;
-    const Material& lm = scene.materials[L.material_id];
-
-    // Sample a point on the light
-    double r1 = random_double();
-    double r2 = random_double();
-    vec3 p_light = L.p0 + r1 * L.u + r2 * L.v;
-
-    vec3 to_light = p_light - rec.p;
-    double dist2 = to_light.length_squared();
-    double dist = std::sqrt(dist2);
-    vec3 wi = to_light / dist;
-
-    double cos_theta = std::max(0.0, dot(rec.normal, wi));
-    double cos_theta_light = std::max(0.0, -dot(L.normal, wi));
-    if (cos_theta <= 0.0 || cos_theta_light <= 0.0)
-        return vec3(0,0,0);
-
-    // Shadow ray
-    ray shadow_ray(rec.p + 1e-3 * rec.normal, wi);
-    hit_record shadow_rec;
-    if (!scene.world.hit(shadow_ray, 1e-3, dist - 1e-3, shadow_rec))
-        return vec3(0,0,0);
-
-    if (shadow_rec.material_id != L.material_id)
-        return vec3(0,0,0);
-
-    double pdf = dist2 / (L.area * cos_theta_light);
-    if (pdf <= 0.0) return vec3(0,0,0);
-
-    vec3 f = mat.albedo / PI_MAT;  // Lambertian BRDF
-    return f * lm.emission * (cos_theta / pdf);
-}
-
-struct PathTracerConfig {
-    int image_width = 400;
-    int image_height = 400;
-    int max_depth = 10;
-    int spp_per_iteration = 1;
-};
+#include "integrator.h"
+#include "wavefront.h"
+#include "tile_scheduler.h"
+#include "profiler.h"
+#include <atomic>
+#include <memory>
 
 struct PathTracerState {
     Scene scene;
     camera cam;
     PathTracerConfig cfg;
     std::vector<vec3> accum_buffer;
+    ConvergenceStats stats;  // per-pixel counts/variance, per-tile residuals
+    AovBuffers aov;          // first-hit guides for the denoiser
     int iterations;
 
+    // Created lazily on the first iteration from cfg.num_threads/tile_size
+    std::shared_ptr<TileScheduler> scheduler;
+    std::vector<Tile> tiles;
+    std::vector<unsigned char> tile_converged;  // adaptive: tile retired
+    std::vector<int> active_tiles;              // tiles traced by the next pass
+    std::vector<WavefrontQueues> wavefront_queues;  // one per worker
+
     PathTracerState(const Scene& scene_in,
                     const camera& cam_in,
                     const PathTracerConfig& cfg_in)
@@ -67,6 +38,8 @@ struct PathTracerState {
           iterations(0)
     {
         accum_buffer.resize(cfg.image_width * cfg.image_height, vec3(0,0,0));
+        stats.reset(cfg.image_width * cfg.image_height, 0);
+        aov.reset(cfg.image_width * cfg.image_height);
     }
 };
 
@@ -82,9 +55,9 @@ inline PathTracerState make_default_state() {
     double aspect = static_cast<double>(cfg.image_width) / cfg.image_height;
 
     // Classic Cornell camera
-    vec3 lookfrom(278, 278, -800);
-    vec3 lookat(278, 278, 0);
-    vec3 vup(0, 1, 0);
+    vec3_t<double> lookfrom(278, 278, -800);
+    vec3_t<double> lookat(278, 278, 0);
+    vec3_t<double> vup(0, 1, 0);
     double vfov = 40.0;
 
     camera cam(lookfrom, lookat, vup, vfov, aspect);
@@ -92,71 +65,234 @@ inline PathTracerState make_default_state() {
     return PathTracerState(scene, cam, cfg);
 }
 
-// Recursive path tracer with NEE + RR + cosine sampling
-inline vec3 ray_color(const ray& r, const Scene& scene, int depth) {
-    if (depth <= 0)
-        return vec3(0,0,0);
+// Rebuild state's scene for cfg.scene and apply cfg.light_sampling and
+// cfg.direct_lighting. The drivers call this once options are parsed.
+inline void load_scene(PathTracerState& state) {
+    state.scene = make_scene(state.cfg.scene);
+    state.scene.lights.strategy = state.cfg.light_sampling;
+    state.scene.lights.mis = state.cfg.direct_lighting == DirectLighting::mis;
+}
 
-    hit_record rec;
-    if (!scene.world.hit(r, 1e-3, 1e9, rec))
-        return vec3(0,0,0);
+// Trace one tile with the megakernel engine, passing each pixel's samples
+// of this pass to sink(idx, batch)
+template <typename Sink>
+inline void trace_tile(const PathTracerState& state, const Tile& tile, Sink&& sink) {
+    int W = state.cfg.image_width;
+    int H = state.cfg.image_height;
 
-    const Material& mat = scene.materials[rec.material_id];
-    vec3 emitted = mat.emission;
+    for (int j = tile.y0; j < tile.y1; ++j) {
+        for (int i = tile.x0; i < tile.x1; ++i) {
+            int idx = j*W + i;
+            uint32_t first_sample = state.stats.first_sample(idx);
+            int spp = state.stats.sample_budget(idx, state.cfg.spp_per_iteration,
+                                                state.cfg.adaptive_max_spp);
+            SampleBatch batch;
+            for (int s = 0; s < spp; ++s) {
+                Sampler sampler(idx, first_sample + s, state.cfg.seed);
+                ray r;
+                {
+                    StageTimer timer(Stage::generate);
+                    double du, dv;
+                    sampler.get2(sample_dim::camera_u, du, dv);
+                    double u = (i + du) / (W - 1);
+                    double v = (j + dv) / (H - 1);
+                    r = state.cam.get_ray(u, 1.0 - v);
+                }
+                FirstHit hit;
+                vec3 c = ray_color(r, state.scene, state.cfg.max_depth, sampler, &hit);
+                batch.add(c, hit);
+            }
+            StageTimer timer(Stage::accumulate);
+            sink(idx, batch);
+        }
+    }
+}
 
-    // If hit light directly, just return emission (no further bounces)
-    if (is_emissive(mat))
-        return emitted;
+// (Re)build the tile list and worker pool if the config changed
+inline void prepare_scheduler(PathTracerState& state) {
+    int threads = resolve_thread_count(state.cfg.num_threads);
+    if (!state.scheduler || state.scheduler->num_threads() != threads)
+        state.scheduler = std::make_shared<TileScheduler>(threads);
 
-    // Direct lighting from the area light
-    vec3 direct = sample_direct_light(scene, rec, mat);
+    int W = state.cfg.image_width;
+    int H = state.cfg.image_height;
+    int ts = state.cfg.tile_size;
+    if (state.tiles.empty() ||
+        state.tiles.back().x1 != W || state.tiles.back().y1 != H ||
+        state.tiles.front().x1 != std::min(ts, W) ||
+        state.tiles.front().y1 != std::min(ts, H))
+        state.tiles = make_tiles(W, H, ts);
+    state.stats.tile_residual.resize(state.tiles.size(), 0.0);
+    state.stats.tile_rel_mse.resize(state.tiles.size(), 0.0);
+    if (state.tile_converged.size() != state.tiles.size())
+        state.tile_converged.assign(state.tiles.size(), 0);
+    if (!state.cfg.adaptive)
+        std::fill(state.tile_converged.begin(), state.tile_converged.end(), 0);
 
-    // Russian roulette
-    double rr_prob = 0.9;
-    if (depth < 3) rr_prob = 1.0;
+    state.active_tiles.clear();
+    for (size_t t = 0; t < state.tiles.size(); ++t)
+        if (!state.tile_converged[t]) state.active_tiles.push_back(static_cast<int>(t));
 
-    if (random_double() > rr_prob)
-        return emitted + direct;
+    if (state.cfg.engine == RenderEngine::wavefront)
+        state.wavefront_queues.resize(threads);
+}
 
-    // Cosine-weighted diffuse bounce
-    vec3 new_dir = sample_diffuse_direction(rec.normal);
-    ray scattered(rec.p + 1e-3 * rec.normal, new_dir);
+// Mean pixel relMSE over the active tiles, used to split the adaptive
+// sample budget; 0 (uniform sampling) while adaptive sampling is off or
+// still warming up
+inline double adaptive_budget_error(const PathTracerState& state) {
+    if (!state.cfg.adaptive || state.iterations < state.cfg.adaptive_warmup)
+        return 0.0;
+    double err = 0.0, area = 0.0;
+    for (int t : state.active_tiles) {
+        const Tile& tile = state.tiles[t];
+        err += state.stats.tile_rel_mse[t];
+        area += double(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+    }
+    return area > 0.0 ? err / area : 0.0;
+}
 
-    vec3 indirect = ray_color(scattered, scene, depth - 1);
-    vec3 f = mat.albedo / PI_MAT;
+// Set up a pass: tile list, worker pool, active tiles and the adaptive
+// sample budget
+inline void begin_pass(PathTracerState& state) {
+    prepare_scheduler(state);
+    state.stats.budget_error = adaptive_budget_error(state);
+    std::fill(state.stats.tile_residual.begin(), state.stats.tile_residual.end(), 0.0);
+}
 
-    // Path throughput update; divide by rr_prob for unbiasedness
-    vec3 bounce = f * indirect * (1.0 / rr_prob);
+// Trace active tile k of the pass on the given worker with the configured
+// engine, without merging: sink(idx, batch) receives every pixel
+template <typename Sink>
+inline void trace_active_tile(PathTracerState& state, int k, int worker, Sink&& sink) {
+    ProfileScope scope("tile", "render", "tile", state.active_tiles[k]);
+    const Tile& tile = state.tiles[state.active_tiles[k]];
+    if (state.cfg.engine == RenderEngine::wavefront)
+        wavefront_trace_tile(state.scene, state.cam, state.cfg, tile,
+                             state.wavefront_queues[worker], state.stats, sink);
+    else
+        trace_tile(state, tile, sink);
+}
 
-    return emitted + direct + bounce;
+// Trace active tile k of the pass on the given worker and record the
+// tile's residual and relMSE sums
+inline void render_active_tile(PathTracerState& state, int k, int worker) {
+    int t = state.active_tiles[k];
+    double residual = 0.0;
+    trace_active_tile(state, k, worker, [&state, &residual](int idx, const SampleBatch& batch) {
+        residual += state.stats.merge(state.accum_buffer, idx, batch);
+        state.aov.add(idx, batch.first_hits, batch.n);
+    });
+    state.stats.tile_residual[t] = residual;
+    state.stats.tile_rel_mse[t] = state.stats.tile_rel_mse_sum(state.cfg.image_width,
+                                                               state.tiles[t]);
+}
+
+// Finish a pass: retire converged tiles and fold the per-tile sums into
+// stats.residual / stats.rel_mse
+inline void end_pass(PathTracerState& state) {
+    if (state.cfg.adaptive && state.iterations + 1 >= state.cfg.adaptive_warmup) {
+        for (int t : state.active_tiles) {
+            const Tile& tile = state.tiles[t];
+            double area = double(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+            if (state.stats.tile_rel_mse[t] / area < state.cfg.adaptive_threshold)
+                state.tile_converged[t] = 1;
+        }
+    }
+    state.stats.reduce(state.cfg.image_width * state.cfg.image_height);
+    state.iterations += 1;
 }
 
+// One progressive pass over the frame. Tiles are disjoint, so workers add
+// into accum_buffer and the per-pixel statistics without synchronization.
+// With cfg.adaptive, only tiles that have not converged are traced.
 inline void path_tracer_iteration(PathTracerState& state) {
-    int W = state.cfg.image_width;
-    int H = state.cfg.image_height;
-    int spp = state.cfg.spp_per_iteration;
+    begin_pass(state);
+    int n_active = static_cast<int>(state.active_tiles.size());
+    state.scheduler->run(n_active, [&state](int k, int worker) {
+        render_active_tile(state, k, worker);
+    });
+    end_pass(state);
+}
 
-    for (int j = 0; j < H; ++j) {
-        for (int i = 0; i < W; ++i) {
-            vec3 pixel_color(0,0,0);
-            for (int s = 0; s < spp; ++s) {
-                double u = (i + random_double()) / (W - 1);
-                double v = (j + random_double()) / (H - 1);
-                ray r = state.cam.get_ray(u, 1.0 - v);
-                pixel_color += ray_color(r, state.scene, state.cfg.max_depth);
-            }
-            state.accum_buffer[j*W + i] += pixel_color;
+// Like path_tracer_iteration, but once cancelled() returns true no further
+// tiles are started and the pass is abandoned: the image then holds part of
+// a pass, so the caller must reset_accumulation before rendering on.
+// Returns false if the pass was abandoned.
+template <typename Cancel>
+inline bool path_tracer_iteration(PathTracerState& state, Cancel&& cancelled) {
+    begin_pass(state);
+    int n_active = static_cast<int>(state.active_tiles.size());
+    std::atomic<bool> abandoned{false};
+    state.scheduler->run(n_active, [&](int k, int worker) {
+        if (abandoned.load(std::memory_order_relaxed) || cancelled()) {
+            abandoned.store(true, std::memory_order_relaxed);
+            return;
+        }
+        render_active_tile(state, k, worker);
+    });
+    if (abandoned.load(std::memory_order_relaxed)) return false;
+    end_pass(state);
+    return true;
+}
+
+// Discard everything accumulated so far (after the camera or scene
+// changed); the next pass starts over with every tile active
+inline void reset_accumulation(PathTracerState& state) {
+    int pixels = state.cfg.image_width * state.cfg.image_height;
+    state.accum_buffer.assign(pixels, vec3(0,0,0));
+    state.stats.reset(pixels, static_cast<int>(state.tiles.size()));
+    state.aov.reset(pixels);
+    state.tile_converged.clear();
+    state.iterations = 0;
+}
+
+// True once adaptive sampling has retired every tile
+inline bool all_tiles_converged(const PathTracerState& state) {
+    return !state.tile_converged.empty() &&
+           std::all_of(state.tile_converged.begin(), state.tile_converged.end(),
+                       [](unsigned char c) { return c != 0; });
+}
+
+// Index of the tile with the highest mean relMSE after the last pass
+inline int worst_tile(const PathTracerState& state) {
+    int worst = 0;
+    double worst_rel = -1.0;
+    for (size_t t = 0; t < state.tiles.size(); ++t) {
+        const Tile& tile = state.tiles[t];
+        double area = double(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+        double rel = state.stats.tile_rel_mse[t] / area;
+        if (rel > worst_rel) {
+            worst_rel = rel;
+            worst = static_cast<int>(t);
         }
     }
-    state.iterations += 1;
+    return worst;
 }
 
-inline std::vector<vec3> normalize_buffer(const PathTracerState& state) {
+// Mean radiance of each pixel
+inline void normalize_buffer(const PathTracerState& state, std::vector<vec3>& out) {
     int n = state.cfg.image_width * state.cfg.image_height;
-    std::vector<vec3> out(n);
-    double scale = 1.0 / (state.iterations * state.cfg.spp_per_iteration);
-    for (int i = 0; i < n; ++i) {
-        out[i] = scale * state.accum_buffer[i];
-    }
+    out.resize(n);
+    const std::vector<real>& count = state.stats.sample_count;
+    for (int i = 0; i < n; ++i)
+        out[i] = count[i] > 0 ? state.accum_buffer[i] / count[i] : vec3(0,0,0);
+}
+
+inline std::vector<vec3> normalize_buffer(const PathTracerState& state) {
+    std::vector<vec3> out;
+    normalize_buffer(state, out);
     return out;
 }
+
+// Write the current image to path, in the format its extension names
+// (.pfm, .raw, anything else: binary .ppm). Returns false on I/O failure.
+inline bool write_output(const PathTracerState& state, const std::string& path) {
+    int W = state.cfg.image_width;
+    int H = state.cfg.image_height;
+    if (has_extension(path, ".raw"))
+        return write_accum_raw(path, state.accum_buffer, state.stats.sample_count, W, H);
+    if (has_extension(path, ".pfm"))
+        return write_pfm(path, normalize_buffer(state), W, H);
+    return write_ppm(path, state.accum_buffer, state.stats.sample_count.data(), W, H,
+                     display_params(state.cfg), state.scheduler.get());
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline profiler: scoped events written as Chrome trace event JSON
+// (open in Perfetto or chrome://tracing).
+//
+// Each thread records into its own fixed-size ring buffer. The owning thread
+// is the only writer: it fills a slot and then publishes it by advancing the
+// head with a release store, so recording takes no lock and never waits.
+// When a ring is full the oldest events are overwritten. Rings are read when
+// the profile is written, after the traced work has finished.
+//
+// Recording is off until profiler_start(); a ProfileScope then costs two
+// clock reads. Event names must be string literals (only the pointer is
+// stored).
+
+struct ProfileEvent {
+    const char* name;
+    const char* category;
+    const char* arg_name;  // nullptr: no argument
+    int64_t arg;
+    int64_t begin_ns, end_ns;
+};
+
+class ProfileRing {
+public:
+    static constexpr size_t CAPACITY = size_t(1) << 16;  // events, power of two
+
+    ProfileRing() : events_(new ProfileEvent[CAPACITY]) {}
+
+    void push(const ProfileEvent& e) {
+        uint64_t h = head_.load(std::memory_order_relaxed);
+        events_[h & (CAPACITY - 1)] = e;
+        head_.store(h + 1, std::memory_order_release);
+    }
+
+    // Calls fn(event) for every event still held, oldest first; returns the
+    // number overwritten
+    template <typename F>
+    uint64_t for_each(F&& fn) const {
+        uint64_t h = head_.load(std::memory_order_acquire);
+        uint64_t first = h > CAPACITY ? h - CAPACITY : 0;
+        for (uint64_t i = first; i < h; ++i) fn(events_[i & (CAPACITY - 1)]);
+        return first;
+    }
+
+    std::string thread_name;
+
+private:
+    std::unique_ptr<ProfileEvent[]> events_;
+    std::atomic<uint64_t> head_{0};
+};
+
+struct ProfilerRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ProfileRing>> rings;  // index = tid
+    std::atomic<bool> enabled{false};
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+inline ProfilerRegistry& profiler_registry() {
+    static ProfilerRegistry registry;
+    return registry;
+}
+
+inline ProfileRing& thread_profile_ring() {
+    thread_local ProfileRing* ring = [] {
+        ProfilerRegistry& reg = profiler_registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.rings.push_back(std::make_unique<ProfileRing>());
+        ProfileRing* r = reg.rings.back().get();
+        r->thread_name = "thread " + std::to_string(reg.rings.size() - 1);
+        return r;
+    }();
+    return *ring;
+}
+
+inline bool profiler_enabled() {
+    return profiler_registry().enabled.load(std::memory_order_relaxed);
+}
+
+// Start recording; timestamps count from here. MPI ranks call it right
+// after a barrier so their timelines line up.
+inline void profiler_start() {
+    ProfilerRegistry& reg = profiler_registry();
+    reg.epoch = std::chrono::steady_clock::now();
+    reg.enabled.store(true, std::memory_order_relaxed);
+}
+
+inline int64_t profiler_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - profiler_registry().epoch).count();
+}
+
+// Label the calling thread's track
+inline void set_profile_thread_name(const std::string& name) {
+    if (profiler_enabled()) thread_profile_ring().thread_name = name;
+}
+
+// Records the lifetime of the scope as one complete ("X") event
+class ProfileScope {
+public:
+    ProfileScope(const char* name, const char* category,
+                 const char* arg_name = nullptr, int64_t arg = 0)
+        : active_(profiler_enabled()) {
+        if (active_) event_ = {name, category, arg_name, arg, profiler_now_ns(), 0};
+    }
+
+    ~ProfileScope() {
+        if (!active_) return;
+        event_.end_ns = profiler_now_ns();
+        thread_profile_ring().push(event_);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    bool active_;
+    ProfileEvent event_;
+};
+
+// Every recorded event and thread name as comma-separated trace events of
+// process pid (the MPI rank), without the enclosing array
+inline std::string profile_events_json(int pid, const std::string& process_name) {
+    ProfilerRegistry& reg = profiler_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    std::string out;
+    auto append_event = [&](const std::string& e) {
+        if (!out.empty()) out += ",\n";
+        out += e;
+    };
+    std::string p = "\"pid\":" + std::to_string(pid);
+    append_event("{\"name\":\"process_name\",\"ph\":\"M\"," + p +
+                 ",\"args\":{\"name\":\"" + process_name + "\"}}");
+
+    char buf[512];
+    for (size_t tid = 0; tid < reg.rings.size(); ++tid) {
+        const ProfileRing& ring = *reg.rings[tid];
+        std::string t = p + ",\"tid\":" + std::to_string(tid);
+        append_event("{\"name\":\"thread_name\",\"ph\":\"M\"," + t +
+                     ",\"args\":{\"name\":\"" + ring.thread_name + "\"}}");
+        uint64_t dropped = ring.for_each([&](const ProfileEvent& e) {
+            int n = std::snprintf(buf, sizeof(buf),
+                                  "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                                  "\"dur\":%.3f,%s",
+                                  e.name, e.category, e.begin_ns * 1e-3,
+                                  (e.end_ns - e.begin_ns) * 1e-3, t.c_str());
+            if (e.arg_name)
+                n += std::snprintf(buf + n, sizeof(buf) - n, ",\"args\":{\"%s\":%lld}",
+                                   e.arg_name, static_cast<long long>(e.arg));
+            std::snprintf(buf + n, sizeof(buf) - n, "}");
+            append_event(buf);
+        });
+        if (dropped > 0)
+            append_event("{\"name\":\"events dropped\",\"ph\":\"i\",\"s\":\"t\",\"ts\":0," + t +
+                         ",\"args\":{\"count\":" + std::to_string(dropped) + "}}");
+    }
+    return out;
+}
+
+// Write trace events (from profile_events_json, possibly of several
+// processes joined with commas) as a Chrome trace file
+inline bool write_profile_json(const std::string& path, const std::string& events) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" << events << "\n]}\n";
+    return bool(out);
+}
@@ -1,19 +1,22 @@
 #pragma once
 #include "vec3.h"
 
-class ray {
+template <typename T>
+class ray_t {
 public:
-    vec3 orig;
-    vec3 dir;
+    vec3_t<T> orig;
+    vec3_t<T> dir;
 
-    ray() {}
-    ray(const vec3& origin, const vec3& direction)
+    ray_t() {}
+    ray_t(const vec3_t<T>& origin, const vec3_t<T>& direction)
         : orig(origin), dir(direction) {}
 
-    vec3 origin() const { return orig; }
-    vec3 direction() const { return dir; }
+    vec3_t<T> origin() const { return orig; }
+    vec3_t<T> direction() const { return dir; }
 
-    vec3 at(double t) const {
+    vec3_t<T> at(T t) const {
         return orig + t*dir;
     }
 };
+
+using ray = ray_t<real>;
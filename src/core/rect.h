@@ -1,77 +1,140 @@
 #pragma once
 #include "hittable.h"
 
-class xy_rect : public hittable {
+// Rects are infinitely thin; pad their boxes along the normal axis
+inline constexpr real RECT_BOX_PAD = real(1e-4);
+
+template <typename T>
+class xy_rect_t {
 public:
-    double x0, x1, y0, y1, k;
+    T x0, x1, y0, y1, k;
     int material_id;
+    int facing = 0;  // as a light: +1/-1 emits toward +z/-z only, 0 both ways
+    int light_id = -1;  // index in the scene's light list, if emissive
 
-    xy_rect() {}
-    xy_rect(double _x0, double _x1, double _y0, double _y1, double _k, int m)
+    xy_rect_t() {}
+    xy_rect_t(T _x0, T _x1, T _y0, T _y1, T _k, int m)
         : x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), material_id(m) {}
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override {
-        double t = (k - r.origin().z()) / r.direction().z();
+    bool hit(const ray_t<T>& r, T t_min, T t_max, hit_record_t<T>& rec) const {
+        T t = (k - r.origin().z()) / r.direction().z();
         if (t < t_min || t > t_max) return false;
-        double x = r.origin().x() + t * r.direction().x();
-        double y = r.origin().y() + t * r.direction().y();
+        T x = r.origin().x() + t * r.direction().x();
+        T y = r.origin().y() + t * r.direction().y();
         if (x < x0 || x > x1 || y < y0 || y > y1) return false;
 
         rec.t = t;
         rec.p = r.at(t);
-        vec3 outward_normal(0, 0, 1);
+        rec.p[2] = k;  // exactly on the plane, for offset_ray_origin
+        vec3_t<T> outward_normal(0, 0, 1);
         rec.set_face_normal(r, outward_normal);
         rec.material_id = material_id;
+        rec.light_id = light_id;
+        return true;
+    }
+
+    bool occludes(const ray_t<T>& r, T t_min, T t_max) const {
+        T t = (k - r.origin().z()) / r.direction().z();
+        if (t < t_min || t > t_max) return false;
+        T x = r.origin().x() + t * r.direction().x();
+        T y = r.origin().y() + t * r.direction().y();
+        return !(x < x0 || x > x1 || y < y0 || y > y1);
+    }
+
+    bool bounding_box(aabb_t<T>& output_box) const {
+        output_box = aabb_t<T>(vec3_t<T>(x0, y0, k - T(RECT_BOX_PAD)), vec3_t<T>(x1, y1, k + T(RECT_BOX_PAD)));
         return true;
     }
 };
 
-class xz_rect : public hittable {
+using xy_rect = xy_rect_t<real>;
+
+template <typename T>
+class xz_rect_t {
 public:
-    double x0, x1, z0, z1, k;
+    T x0, x1, z0, z1, k;
     int material_id;
+    int facing = 0;  // as a light: +1/-1 emits toward +y/-y only, 0 both ways
+    int light_id = -1;  // index in the scene's light list, if emissive
 
-    xz_rect() {}
-    xz_rect(double _x0, double _x1, double _z0, double _z1, double _k, int m)
+    xz_rect_t() {}
+    xz_rect_t(T _x0, T _x1, T _z0, T _z1, T _k, int m)
         : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), material_id(m) {}
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override {
-        double t = (k - r.origin().y()) / r.direction().y();
+    bool hit(const ray_t<T>& r, T t_min, T t_max, hit_record_t<T>& rec) const {
+        T t = (k - r.origin().y()) / r.direction().y();
         if (t < t_min || t > t_max) return false;
-        double x = r.origin().x() + t * r.direction().x();
-        double z = r.origin().z() + t * r.direction().z();
+        T x = r.origin().x() + t * r.direction().x();
+        T z = r.origin().z() + t * r.direction().z();
         if (x < x0 || x > x1 || z < z0 || z > z1) return false;
 
         rec.t = t;
         rec.p = r.at(t);
-        vec3 outward_normal(0, 1, 0);
+        rec.p[1] = k;  // exactly on the plane, for offset_ray_origin
+        vec3_t<T> outward_normal(0, 1, 0);
         rec.set_face_normal(r, outward_normal);
         rec.material_id = material_id;
+        rec.light_id = light_id;
+        return true;
+    }
+
+    bool occludes(const ray_t<T>& r, T t_min, T t_max) const {
+        T t = (k - r.origin().y()) / r.direction().y();
+        if (t < t_min || t > t_max) return false;
+        T x = r.origin().x() + t * r.direction().x();
+        T z = r.origin().z() + t * r.direction().z();
+        return !(x < x0 || x > x1 || z < z0 || z > z1);
+    }
+
+    bool bounding_box(aabb_t<T>& output_box) const {
+        output_box = aabb_t<T>(vec3_t<T>(x0, k - T(RECT_BOX_PAD), z0), vec3_t<T>(x1, k + T(RECT_BOX_PAD), z1));
         return true;
     }
 };
 
-class yz_rect : public hittable {
+using xz_rect = xz_rect_t<real>;
+
+template <typename T>
+class yz_rect_t {
 public:
-    double y0, y1, z0, z1, k;
+    T y0, y1, z0, z1, k;
     int material_id;
+    int facing = 0;  // as a light: +1/-1 emits toward +x/-x only, 0 both ways
+    int light_id = -1;  // index in the scene's light list, if emissive
 
-    yz_rect() {}
-    yz_rect(double _y0, double _y1, double _z0, double _z1, double _k, int m)
+    yz_rect_t() {}
+    yz_rect_t(T _y0, T _y1, T _z0, T _z1, T _k, int m)
         : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), material_id(m) {}
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override {
-        double t = (k - r.origin().x()) / r.direction().x();
+    bool hit(const ray_t<T>& r, T t_min, T t_max, hit_record_t<T>& rec) const {
+        T t = (k - r.origin().x()) / r.direction().x();
         if (t < t_min || t > t_max) return false;
-        double y = r.origin().y() + t * r.direction().y();
-        double z = r.origin().z() + t * r.direction().z();
+        T y = r.origin().y() + t * r.direction().y();
+        T z = r.origin().z() + t * r.direction().z();
         if (y < y0 || y > y1 || z < z0 || z > z1) return false;
 
         rec.t = t;
         rec.p = r.at(t);
-        vec3 outward_normal(1, 0, 0);
+        rec.p[0] = k;  // exactly on the plane, for offset_ray_origin
+        vec3_t<T> outward_normal(1, 0, 0);
         rec.set_face_normal(r, outward_normal);
         rec.material_id = material_id;
+        rec.light_id = light_id;
+        return true;
+    }
+
+    bool occludes(const ray_t<T>& r, T t_min, T t_max) const {
+        T t = (k - r.origin().x()) / r.direction().x();
+        if (t < t_min || t > t_max) return false;
+        T y = r.origin().y() + t * r.direction().y();
+        T z = r.origin().z() + t * r.direction().z();
+        return !(y < y0 || y > y1 || z < z0 || z > z1);
+    }
+
+    bool bounding_box(aabb_t<T>& output_box) const {
+        output_box = aabb_t<T>(vec3_t<T>(k - T(RECT_BOX_PAD), y0, z0), vec3_t<T>(k + T(RECT_BOX_PAD), y1, z1));
         return true;
     }
 };
+
+using yz_rect = yz_rect_t<real>;
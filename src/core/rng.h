@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+
+// Random number generation.
+//
+// Two generators live here:
+//  * pcg32      -- small sequential generator behind random_double(), used
+//                  off the hot path (scene setup, tests, legacy callers).
+//  * Sampler    -- counter-based: every value is a pure hash of
+//                  (pixel, sample index, bounce, dimension), so a given
+//                  sample is identical whatever thread, tile, rank or
+//                  engine happens to trace it.
+
+// PCG-XSH-RR 32-bit output, 64-bit state (O'Neill 2014)
+class pcg32 {
+public:
+    pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+    pcg32(uint64_t init_state, uint64_t stream) { seed(init_state, stream); }
+
+    void seed(uint64_t init_state, uint64_t stream) {
+        state_ = 0;
+        inc_ = (stream << 1u) | 1u;
+        next_u32();
+        state_ += init_state;
+        next_u32();
+    }
+
+    uint32_t next_u32() {
+        uint64_t old = state_;
+        state_ = old * 6364136223846793005ULL + inc_;
+        uint32_t xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = static_cast<uint32_t>(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31u));
+    }
+
+private:
+    uint64_t state_;
+    uint64_t inc_;
+};
+
+// pcg4d hash (Jarzynski & Olano 2020): four 32-bit inputs to four
+// well-mixed 32-bit outputs in a dozen integer ops
+inline void pcg4d(uint32_t v[4]) {
+    for (int i = 0; i < 4; ++i) v[i] = v[i] * 1664525u + 1013904223u;
+    v[0] += v[1]*v[3]; v[1] += v[2]*v[0]; v[2] += v[0]*v[1]; v[3] += v[1]*v[2];
+    for (int i = 0; i < 4; ++i) v[i] ^= v[i] >> 16u;
+    v[0] += v[1]*v[3]; v[1] += v[2]*v[0]; v[2] += v[0]*v[1]; v[3] += v[1]*v[2];
+}
+
+inline double u32_to_unit_double(uint32_t x) {
+    return x * (1.0 / 4294967296.0);  // [0, 1)
+}
+
+// Dimensions drawn at each path vertex. Camera jitter is taken at bounce 0.
+// Pairs that are sampled together share a 4-wide hash block.
+namespace sample_dim {
+inline constexpr uint32_t camera_u = 0;
+inline constexpr uint32_t camera_v = 1;
+inline constexpr uint32_t roulette = 2;
+inline constexpr uint32_t light_select = 3;
+inline constexpr uint32_t light_u  = 4;
+inline constexpr uint32_t light_v  = 5;
+inline constexpr uint32_t bsdf_u   = 6;
+inline constexpr uint32_t bsdf_v   = 7;
+}
+
+// Counter-based sampler for one (pixel, sample) path. Tracers set `bounce`
+// to the vertex index before drawing that vertex's dimensions.
+struct Sampler {
+    uint32_t pixel;    // global pixel index j*W + i
+    uint32_t sample;   // per-pixel sample index across all iterations
+    uint32_t seed;     // render seed, lets independent renders differ
+    uint32_t bounce = 0;
+
+    Sampler(uint32_t pixel_in, uint32_t sample_in, uint32_t seed_in = 0)
+        : pixel(pixel_in), sample(sample_in), seed(seed_in) {}
+
+    void hash_block(uint32_t dim, uint32_t out[4]) const {
+        out[0] = pixel;
+        out[1] = sample;
+        out[2] = seed;
+        out[3] = (bounce << 16) | (dim >> 2);  // both far below 2^16
+        pcg4d(out);
+    }
+
+    double get(uint32_t dim) const {
+        uint32_t v[4];
+        hash_block(dim, v);
+        return u32_to_unit_double(v[dim & 3]);
+    }
+
+    // Two dimensions from one hash; dim must be even
+    void get2(uint32_t dim, double& a, double& b) const {
+        uint32_t v[4];
+        hash_block(dim, v);
+        a = u32_to_unit_double(v[dim & 3]);
+        b = u32_to_unit_double(v[(dim & 3) + 1]);
+    }
+};
@@ -1,79 +1,130 @@
 #pragma once
+#include "config.h"
 #include "hittable_list.h"
-#include "sphere.h"
-#include "rect.h"
+#include "lights.h"
 #include "material.h"
 #include <vector>
 
-struct AreaLight {
-    vec3 p0;
-    vec3 u;
-    vec3 v;
-    vec3 normal;
-    double area;
-    int material_id;
-};
-
 struct Scene {
     hittable_list world;
     std::vector<Material> materials;
-    AreaLight light;
+    LightList lights;  // every emissive primitive, for NEE
+
+    // Call once the world is complete: builds the BVHs and the light list.
+    // Emitters stay opaque to shadow rays: a shadow ray stops short of its
+    // own light sample, so any emitter it meets is in front of the sample.
+    void finalize() {
+        world.build_acceleration();
+        lights.build(world, materials);
+    }
 };
 
-inline Scene make_cornell_scene() {
-    Scene s;
-
+// Walls and the two spheres of the Cornell box, with materials white, red
+// and green at indices 0-2; the caller adds the lighting. With
+// mirror_sphere the back sphere is a mirror (material 3).
+inline void add_cornell_box(Scene& s, bool mirror_sphere = false) {
     // Indices into materials
     int white = 0;
     int red   = 1;
     int green = 2;
-    int light = 3;
 
     // Materials: Cornell style
     s.materials = {
         Material(vec3(0.73, 0.73, 0.73), vec3(0,0,0), false),  // white
         Material(vec3(0.65, 0.05, 0.05), vec3(0,0,0), false),  // red
         Material(vec3(0.12, 0.45, 0.15), vec3(0,0,0), false),  // green
-        Material(vec3(0.0, 0.0, 0.0),   vec3(15,15,15), false) // bright area light
     };
 
     // Cornell box dimensions from "Ray Tracing: The Next Week" style
     // Box from (0,0,0) to (555,555,555)
 
     // Left wall (green)  x = 0
-    s.world.add(std::make_shared<yz_rect>(0, 555, 0, 555, 555, green));
+    s.world.add(yz_rect(0, 555, 0, 555, 555, green));
 
     // Right wall (red) x = 555
-    s.world.add(std::make_shared<yz_rect>(0, 555, 0, 555, 0, red));
+    s.world.add(yz_rect(0, 555, 0, 555, 0, red));
 
     // Floor (white) y = 0
-    s.world.add(std::make_shared<xz_rect>(0, 555, 0, 555, 0, white));
+    s.world.add(xz_rect(0, 555, 0, 555, 0, white));
 
     // Ceiling (white) y = 555
-    s.world.add(std::make_shared<xz_rect>(0, 555, 0, 555, 555, white));
+    s.world.add(xz_rect(0, 555, 0, 555, 555, white));
 
     // Back wall (white) z = 555
-    s.world.add(std::make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+    s.world.add(xy_rect(0, 555, 0, 555, 555, white));
 
-    // Area light on the ceiling: a rectangle in xz-plane at y = 554
-    double lx0 = 213, lx1 = 343;
-    double lz0 = 227, lz1 = 332;
-    double ly  = 554;
+    // Two spheres in the box (white diffuse)
+    s.world.add(sphere(vec3(185, 82.5, 169), 82.5, white));
+    int back = white;
+    if (mirror_sphere) {
+        back = static_cast<int>(s.materials.size());
+        s.materials.push_back(Material(vec3(0.9, 0.9, 0.9), vec3(0,0,0), true));
+    }
+    s.world.add(sphere(vec3(368, 82.5, 351), 82.5, back));
+}
 
-    auto light_rect = std::make_shared<xz_rect>(lx0, lx1, lz0, lz1, ly, light);
-    s.world.add(light_rect);
+inline Scene make_cornell_scene(bool mirror_sphere = false) {
+    Scene s;
+    add_cornell_box(s, mirror_sphere);
 
-    // Fill area-light descriptor for sampling
-    s.light.p0 = vec3(lx0, ly, lz0);
-    s.light.u  = vec3(lx1 - lx0, 0, 0);
-    s.light.v  = vec3(0, 0, lz1 - lz0);
-    s.light.normal = vec3(0, -1, 0); // points down into the box
-    s.light.area   = cross(s.light.u, s.light.v).length();
-    s.light.material_id = light;
+    // Area light on the ceiling: a rectangle in xz-plane at y = 554,
+    // shining down into the box
+    int light = static_cast<int>(s.materials.size());
+    s.materials.push_back(Material(vec3(0.0, 0.0, 0.0), vec3(15,15,15), false));
+    xz_rect lamp(213, 343, 227, 332, 554, light);
+    lamp.facing = -1;
+    s.world.add(lamp);
 
-    // Two spheres in the box (white diffuse)
-    s.world.add(std::make_shared<sphere>(vec3(185, 82.5, 169), 82.5, white));
-    s.world.add(std::make_shared<sphere>(vec3(368, 82.5, 351), 82.5, white));
+    s.finalize();
+    return s;
+}
 
+// The box lit by 256 small ceiling panels of varying brightness and tint,
+// about as much light in total as the single Cornell light, plus a small
+// glowing sphere
+inline Scene make_ceiling_grid_scene() {
+    Scene s;
+    add_cornell_box(s);
+
+    // 5 brightness levels x warm/cool tint
+    int first = static_cast<int>(s.materials.size());
+    for (int level = 0; level < 5; ++level) {
+        real e = real(1.0 + 0.5 * level);
+        s.materials.push_back(Material(vec3(0,0,0), e * vec3(1.0, 0.85, 0.7), false));
+        s.materials.push_back(Material(vec3(0,0,0), e * vec3(0.75, 0.85, 1.0), false));
+    }
+
+    const int N = 16;
+    const real pitch = real(555.0 / N), size = 20;
+    for (int j = 0; j < N; ++j) {
+        for (int i = 0; i < N; ++i) {
+            real x0 = (i + real(0.5)) * pitch - size / 2;
+            real z0 = (j + real(0.5)) * pitch - size / 2;
+            int m = first + 2 * ((7 * i + 3 * j) % 5) + ((i + j) & 1);
+            xz_rect panel(x0, x0 + size, z0, z0 + size, 554, m);
+            panel.facing = -1;
+            s.world.add(panel);
+        }
+    }
+
+    int glow = static_cast<int>(s.materials.size());
+    s.materials.push_back(Material(vec3(0,0,0), vec3(8, 5, 2), false));
+    s.world.add(sphere(vec3(420, 320, 160), 15, glow));
+
+    s.finalize();
     return s;
 }
+
+inline Scene make_scene(SceneKind kind) {
+    if (kind == SceneKind::ceiling_grid) return make_ceiling_grid_scene();
+    return make_cornell_scene(kind == SceneKind::cornell_mirror);
+}
+
+// Name of a scene as --scene spells it
+inline const char* scene_name(SceneKind kind) {
+    switch (kind) {
+        case SceneKind::ceiling_grid: return "ceiling-grid";
+        case SceneKind::cornell_mirror: return "cornell-mirror";
+        default: return "cornell";
+    }
+}
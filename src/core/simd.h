@@ -0,0 +1,267 @@
+#pragma once
+#include <string>
+#include "config.h"
+
+// Runtime-dispatched x86 SIMD support.
+//
+// Kernels are written once against a small `ops` interface (vector type,
+// mask type, width and a handful of arithmetic/compare helpers) and compiled
+// once per ISA by including them between PT_SIMD_TARGET_BEGIN/END with the
+// matching ops struct in scope. The active ISA is picked from CPUID on first
+// use and can be lowered (never raised) with set_simd_isa().
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) \
+    && !defined(__HIP_DEVICE_COMPILE__) && !defined(__CUDA_ARCH__)
+#define PT_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define PT_HAVE_X86_SIMD 0
+#endif
+
+#define PT_SIMD_STR_(x) #x
+#define PT_SIMD_STR(x) PT_SIMD_STR_(x)
+
+#if PT_HAVE_X86_SIMD && defined(__clang__)
+#define PT_SIMD_TARGET_BEGIN(isa) \
+    _Pragma(PT_SIMD_STR(clang attribute push(__attribute__((target(isa))), apply_to = function)))
+#define PT_SIMD_TARGET_END() _Pragma("clang attribute pop")
+#elif PT_HAVE_X86_SIMD
+// fp-contract=off: AVX-512 implies FMA, and fused mul/add would round
+// differently from the scalar hit() code the kernels must agree with
+#define PT_SIMD_TARGET_BEGIN(isa) \
+    _Pragma("GCC push_options") _Pragma(PT_SIMD_STR(GCC target(isa))) \
+    _Pragma("GCC optimize(\"fp-contract=off\")")
+#define PT_SIMD_TARGET_END() _Pragma("GCC pop_options")
+#endif
+
+enum class simd_isa { scalar = 0, sse4 = 1, avx2 = 2, avx512 = 3 };
+
+inline const char* simd_isa_name(simd_isa isa) {
+    switch (isa) {
+    case simd_isa::sse4:   return "sse4";
+    case simd_isa::avx2:   return "avx2";
+    case simd_isa::avx512: return "avx512";
+    default:               return "scalar";
+    }
+}
+
+inline bool parse_simd_isa(const std::string& name, simd_isa& isa) {
+    for (simd_isa i : {simd_isa::scalar, simd_isa::sse4, simd_isa::avx2, simd_isa::avx512}) {
+        if (name == simd_isa_name(i)) {
+            isa = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline simd_isa detect_simd_isa() {
+#if PT_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return simd_isa::avx512;
+    if (__builtin_cpu_supports("avx2"))    return simd_isa::avx2;
+    if (__builtin_cpu_supports("sse4.1"))  return simd_isa::sse4;
+#endif
+    return simd_isa::scalar;
+}
+
+inline simd_isa& simd_isa_setting() {
+    static simd_isa isa = detect_simd_isa();
+    return isa;
+}
+
+inline simd_isa active_simd_isa() { return simd_isa_setting(); }
+
+// Select a kernel set, e.g. to compare against the scalar path. Requests
+// above what the CPU supports are clamped.
+inline void set_simd_isa(simd_isa isa) {
+    simd_isa best = detect_simd_isa();
+    simd_isa_setting() = static_cast<int>(isa) > static_cast<int>(best) ? best : isa;
+}
+
+// Widest vector any kernel uses, in lanes of `real` (8 doubles or 16
+// floats); SoA buffers are padded by this much so full-width loads at the
+// end of a slice stay in bounds.
+inline constexpr int SIMD_MAX_WIDTH = 64 / static_cast<int>(sizeof(real));
+
+#if PT_HAVE_X86_SIMD
+
+PT_SIMD_TARGET_BEGIN("sse4.1")
+struct sse4_f64_ops {
+    using scalar = double;
+    using vec = __m128d;
+    using mask = __m128d;
+    static constexpr int width = 2;
+
+    static vec set1(double x) { return _mm_set1_pd(x); }
+    static vec iota() { return _mm_set_pd(1, 0); }
+    static vec loadu(const double* p) { return _mm_loadu_pd(p); }
+    static void storeu(double* p, vec a) { _mm_storeu_pd(p, a); }
+    static vec add(vec a, vec b) { return _mm_add_pd(a, b); }
+    static vec sub(vec a, vec b) { return _mm_sub_pd(a, b); }
+    static vec mul(vec a, vec b) { return _mm_mul_pd(a, b); }
+    static vec div(vec a, vec b) { return _mm_div_pd(a, b); }
+    static vec max(vec a, vec b) { return _mm_max_pd(a, b); }
+    static vec sqrt(vec a) { return _mm_sqrt_pd(a); }
+    static mask ge(vec a, vec b) { return _mm_cmpge_pd(a, b); }
+    static mask le(vec a, vec b) { return _mm_cmple_pd(a, b); }
+    static mask lt(vec a, vec b) { return _mm_cmplt_pd(a, b); }
+    static mask mask_and(mask a, mask b) { return _mm_and_pd(a, b); }
+    static mask mask_or(mask a, mask b) { return _mm_or_pd(a, b); }
+    static bool any(mask m) { return _mm_movemask_pd(m) != 0; }
+    static vec select(mask m, vec a, vec b) { return _mm_blendv_pd(b, a, m); }
+    static double reduce_add(vec a) { return _mm_cvtsd_f64(_mm_add_pd(a, _mm_unpackhi_pd(a, a))); }
+};
+PT_SIMD_TARGET_END()
+
+PT_SIMD_TARGET_BEGIN("avx2")
+struct avx2_f64_ops {
+    using scalar = double;
+    using vec = __m256d;
+    using mask = __m256d;
+    static constexpr int width = 4;
+
+    static vec set1(double x) { return _mm256_set1_pd(x); }
+    static vec iota() { return _mm256_set_pd(3, 2, 1, 0); }
+    static vec loadu(const double* p) { return _mm256_loadu_pd(p); }
+    static void storeu(double* p, vec a) { _mm256_storeu_pd(p, a); }
+    static vec add(vec a, vec b) { return _mm256_add_pd(a, b); }
+    static vec sub(vec a, vec b) { return _mm256_sub_pd(a, b); }
+    static vec mul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+    static vec div(vec a, vec b) { return _mm256_div_pd(a, b); }
+    static vec max(vec a, vec b) { return _mm256_max_pd(a, b); }
+    static vec sqrt(vec a) { return _mm256_sqrt_pd(a); }
+    static mask ge(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    static mask le(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+    static mask lt(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static mask mask_and(mask a, mask b) { return _mm256_and_pd(a, b); }
+    static mask mask_or(mask a, mask b) { return _mm256_or_pd(a, b); }
+    static bool any(mask m) { return _mm256_movemask_pd(m) != 0; }
+    static vec select(mask m, vec a, vec b) { return _mm256_blendv_pd(b, a, m); }
+    static double reduce_add(vec a) {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+        return _mm_cvtsd_f64(_mm_add_pd(s, _mm_unpackhi_pd(s, s)));
+    }
+};
+PT_SIMD_TARGET_END()
+
+PT_SIMD_TARGET_BEGIN("avx512f")
+struct avx512_f64_ops {
+    using scalar = double;
+    using vec = __m512d;
+    using mask = __mmask8;
+    static constexpr int width = 8;
+
+    static vec set1(double x) { return _mm512_set1_pd(x); }
+    static vec iota() { return _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0); }
+    static vec loadu(const double* p) { return _mm512_loadu_pd(p); }
+    static void storeu(double* p, vec a) { _mm512_storeu_pd(p, a); }
+    static vec add(vec a, vec b) { return _mm512_add_pd(a, b); }
+    static vec sub(vec a, vec b) { return _mm512_sub_pd(a, b); }
+    static vec mul(vec a, vec b) { return _mm512_mul_pd(a, b); }
+    static vec div(vec a, vec b) { return _mm512_div_pd(a, b); }
+    static vec max(vec a, vec b) { return _mm512_max_pd(a, b); }
+    static vec sqrt(vec a) { return _mm512_sqrt_pd(a); }
+    static mask ge(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+    static mask le(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+    static mask lt(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static mask mask_and(mask a, mask b) { return static_cast<mask>(a & b); }
+    static mask mask_or(mask a, mask b) { return static_cast<mask>(a | b); }
+    static bool any(mask m) { return m != 0; }
+    static vec select(mask m, vec a, vec b) { return _mm512_mask_blend_pd(m, b, a); }
+    static double reduce_add(vec a) { return _mm512_reduce_add_pd(a); }
+};
+PT_SIMD_TARGET_END()
+
+PT_SIMD_TARGET_BEGIN("sse4.1")
+struct sse4_f32_ops {
+    using scalar = float;
+    using vec = __m128;
+    using mask = __m128;
+    static constexpr int width = 4;
+
+    static vec set1(float x) { return _mm_set1_ps(x); }
+    static vec iota() { return _mm_set_ps(3, 2, 1, 0); }
+    static vec loadu(const float* p) { return _mm_loadu_ps(p); }
+    static void storeu(float* p, vec a) { _mm_storeu_ps(p, a); }
+    static vec add(vec a, vec b) { return _mm_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm_sub_ps(a, b); }
+    static vec mul(vec a, vec b) { return _mm_mul_ps(a, b); }
+    static vec div(vec a, vec b) { return _mm_div_ps(a, b); }
+    static vec max(vec a, vec b) { return _mm_max_ps(a, b); }
+    static vec sqrt(vec a) { return _mm_sqrt_ps(a); }
+    static mask ge(vec a, vec b) { return _mm_cmpge_ps(a, b); }
+    static mask le(vec a, vec b) { return _mm_cmple_ps(a, b); }
+    static mask lt(vec a, vec b) { return _mm_cmplt_ps(a, b); }
+    static mask mask_and(mask a, mask b) { return _mm_and_ps(a, b); }
+    static mask mask_or(mask a, mask b) { return _mm_or_ps(a, b); }
+    static bool any(mask m) { return _mm_movemask_ps(m) != 0; }
+    static vec select(mask m, vec a, vec b) { return _mm_blendv_ps(b, a, m); }
+    static float reduce_add(vec a) {
+        __m128 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+    }
+};
+PT_SIMD_TARGET_END()
+
+PT_SIMD_TARGET_BEGIN("avx2")
+struct avx2_f32_ops {
+    using scalar = float;
+    using vec = __m256;
+    using mask = __m256;
+    static constexpr int width = 8;
+
+    static vec set1(float x) { return _mm256_set1_ps(x); }
+    static vec iota() { return _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0); }
+    static vec loadu(const float* p) { return _mm256_loadu_ps(p); }
+    static void storeu(float* p, vec a) { _mm256_storeu_ps(p, a); }
+    static vec add(vec a, vec b) { return _mm256_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm256_sub_ps(a, b); }
+    static vec mul(vec a, vec b) { return _mm256_mul_ps(a, b); }
+    static vec div(vec a, vec b) { return _mm256_div_ps(a, b); }
+    static vec max(vec a, vec b) { return _mm256_max_ps(a, b); }
+    static vec sqrt(vec a) { return _mm256_sqrt_ps(a); }
+    static mask ge(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static mask le(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static mask lt(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static mask mask_and(mask a, mask b) { return _mm256_and_ps(a, b); }
+    static mask mask_or(mask a, mask b) { return _mm256_or_ps(a, b); }
+    static bool any(mask m) { return _mm256_movemask_ps(m) != 0; }
+    static vec select(mask m, vec a, vec b) { return _mm256_blendv_ps(b, a, m); }
+    static float reduce_add(vec a) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+    }
+};
+PT_SIMD_TARGET_END()
+
+PT_SIMD_TARGET_BEGIN("avx512f")
+struct avx512_f32_ops {
+    using scalar = float;
+    using vec = __m512;
+    using mask = __mmask16;
+    static constexpr int width = 16;
+
+    static vec set1(float x) { return _mm512_set1_ps(x); }
+    static vec iota() { return _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0); }
+    static vec loadu(const float* p) { return _mm512_loadu_ps(p); }
+    static void storeu(float* p, vec a) { _mm512_storeu_ps(p, a); }
+    static vec add(vec a, vec b) { return _mm512_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm512_sub_ps(a, b); }
+    static vec mul(vec a, vec b) { return _mm512_mul_ps(a, b); }
+    static vec div(vec a, vec b) { return _mm512_div_ps(a, b); }
+    static vec max(vec a, vec b) { return _mm512_max_ps(a, b); }
+    static vec sqrt(vec a) { return _mm512_sqrt_ps(a); }
+    static mask ge(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+    static mask le(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+    static mask lt(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static mask mask_and(mask a, mask b) { return static_cast<mask>(a & b); }
+    static mask mask_or(mask a, mask b) { return static_cast<mask>(a | b); }
+    static bool any(mask m) { return m != 0; }
+    static vec select(mask m, vec a, vec b) { return _mm512_mask_blend_ps(m, b, a); }
+    static float reduce_add(vec a) { return _mm512_reduce_add_ps(a); }
+};
+PT_SIMD_TARGET_END()
+
+#endif // PT_HAVE_X86_SIMD
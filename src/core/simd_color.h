@@ -0,0 +1,141 @@
+#pragma once
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+// Display encoding of linear radiance, dispatched on active_simd_isa()
+// like the intersection kernels.
+//
+// encode_display fuses the whole transform into one pass over the
+// accumulation buffer: per pixel mean (sum / sample count), exposure, tone
+// curve and 8-bit encoding, written straight into the output. The scalar
+// functions below define the transform; the SIMD kernels follow them step
+// by step (sRGB uses a sqrt-only approximation, within 0.25 of a code
+// value of the exact curve, so that every ISA produces the same bytes).
+
+// The display transform of a config, resolved once per frame
+struct DisplayParams {
+    real scale = 1;  // 2^exposure
+    Tonemap tonemap = Tonemap::clamp;
+    DisplayEncoding encoding = DisplayEncoding::gamma2;
+};
+
+inline DisplayParams display_params(const PathTracerConfig& cfg) {
+    DisplayParams p;
+    p.scale = static_cast<real>(std::exp2(cfg.exposure));
+    p.tonemap = cfg.tonemap;
+    p.encoding = cfg.encoding;
+    return p;
+}
+
+// Coefficients of the ACES fit, (x (a x + b)) / (x (c x + d) + e)
+inline constexpr double ACES_A = 2.51, ACES_B = 0.03, ACES_C = 2.43, ACES_D = 0.59, ACES_E = 0.14;
+
+// Largest linear value of the sRGB curve's linear segment
+inline constexpr double SRGB_LINEAR_MAX = 0.0031308;
+
+template <typename T>
+inline T tonemap_value(T x, Tonemap op) {
+    switch (op) {
+    case Tonemap::reinhard: return x / (T(1) + x);
+    case Tonemap::aces:
+        return (x * (T(ACES_A) * x + T(ACES_B))) / (x * (T(ACES_C) * x + T(ACES_D)) + T(ACES_E));
+    default: return x;
+    }
+}
+
+template <typename T>
+inline T encode_value(T x, DisplayEncoding e) {
+    if (e == DisplayEncoding::gamma2) return std::sqrt(x);
+    if (x <= T(SRGB_LINEAR_MAX)) return T(12.92) * x;
+    T s1 = std::sqrt(x), s2 = std::sqrt(s1), s3 = std::sqrt(s2);
+    return T(0.662002687) * s1 + T(0.684122060) * s2 - T(0.323583601) * s3 - T(0.0225411470) * x;
+}
+
+// trunc(256 * min(v, 0.999)); NaN (an infinite input) saturates
+template <typename T>
+inline uint32_t quantize8(T v) {
+    return static_cast<uint32_t>(T(256) * (v < T(0.999) ? v : T(0.999)));
+}
+
+// One linear value, already scaled by exposure / sample count, to 8 bits;
+// NaN and negative values encode as 0
+template <typename T>
+inline uint32_t display_value8(T x, const DisplayParams& p) {
+    x = x > 0 ? x : T(0);
+    return quantize8(encode_value(tonemap_value(x, p.tonemap), p.encoding));
+}
+
+namespace simd_scalar {
+// Pixel i of the run: sums accum[3i..3i+2] over count[i] samples
+template <bool ARGB>
+inline void encode_display(const real* accum, const real* count, int n,
+                           const DisplayParams& p, void* out) {
+    for (int i = 0; i < n; ++i) {
+        real inv = !count ? p.scale : count[i] > 0 ? p.scale / count[i] : real(0);
+        uint32_t r = display_value8(accum[3 * i] * inv, p);
+        uint32_t g = display_value8(accum[3 * i + 1] * inv, p);
+        uint32_t b = display_value8(accum[3 * i + 2] * inv, p);
+        if constexpr (ARGB) {
+            static_cast<uint32_t*>(out)[i] = (255u << 24) | (r << 16) | (g << 8) | b;
+        } else {
+            uint8_t* px = static_cast<uint8_t*>(out) + 3 * size_t(i);
+            px[0] = static_cast<uint8_t>(r);
+            px[1] = static_cast<uint8_t>(g);
+            px[2] = static_cast<uint8_t>(b);
+        }
+    }
+}
+}
+
+#if PT_HAVE_X86_SIMD
+namespace simd_sse4 {
+PT_SIMD_TARGET_BEGIN("sse4.1")
+using ops = std::conditional_t<std::is_same_v<real, float>, sse4_f32_ops, sse4_f64_ops>;
+#include "simd_color.inl"
+PT_SIMD_TARGET_END()
+}
+
+namespace simd_avx2 {
+PT_SIMD_TARGET_BEGIN("avx2")
+using ops = std::conditional_t<std::is_same_v<real, float>, avx2_f32_ops, avx2_f64_ops>;
+#include "simd_color.inl"
+PT_SIMD_TARGET_END()
+}
+
+namespace simd_avx512 {
+PT_SIMD_TARGET_BEGIN("avx512f")
+using ops = std::conditional_t<std::is_same_v<real, float>, avx512_f32_ops, avx512_f64_ops>;
+#include "simd_color.inl"
+PT_SIMD_TARGET_END()
+}
+#endif
+
+// n pixels of accumulated radiance (accum: r, g, b sums per pixel; count:
+// samples per pixel, or null if accum already holds means) to 8-bit RGB
+// triples, or to opaque ARGB8888 words
+template <bool ARGB>
+inline void encode_display(const real* accum, const real* count, int n,
+                           const DisplayParams& p, void* out) {
+#if PT_HAVE_X86_SIMD
+    switch (active_simd_isa()) {
+    case simd_isa::avx512: simd_avx512::encode_display<ARGB>(accum, count, n, p, out); return;
+    case simd_isa::avx2:   simd_avx2::encode_display<ARGB>(accum, count, n, p, out); return;
+    case simd_isa::sse4:   simd_sse4::encode_display<ARGB>(accum, count, n, p, out); return;
+    default: break;
+    }
+#endif
+    simd_scalar::encode_display<ARGB>(accum, count, n, p, out);
+}
+
+inline void encode_display_rgb8(const real* accum, const real* count, int n,
+                                const DisplayParams& p, uint8_t* out) {
+    encode_display<false>(accum, count, n, p, out);
+}
+
+inline void encode_display_argb(const real* accum, const real* count, int n,
+                                const DisplayParams& p, uint32_t* out) {
+    encode_display<true>(accum, count, n, p, out);
+}
@@ -0,0 +1,86 @@
+// simd_color.inl -- ISA-generic display encoding.
+//
+// Included by simd_color.h once per ISA, like simd_intersect.inl.
+
+// The display transform of simd_color.h on ops::width pixels at a time.
+// Pixels are deinterleaved into per-channel lanes, transformed as vectors
+// and packed back into out (RGB triples, or ARGB words if ARGB).
+template <bool ARGB>
+inline void encode_display(const ops::scalar* accum, const ops::scalar* count, int n,
+                           const DisplayParams& p, void* out) {
+    using scalar = ops::scalar;
+    using vec = ops::vec;
+    constexpr int W = ops::width;
+
+    const vec zero = ops::set1(0);
+    const vec one = ops::set1(1);
+    const vec scale = ops::set1(p.scale);
+    const vec top = ops::set1(static_cast<scalar>(0.999));
+    const vec to8 = ops::set1(256);
+    alignas(64) scalar lanes[3][W];
+
+    auto tonemap = [&](vec x) {
+        switch (p.tonemap) {
+        case Tonemap::reinhard: return ops::div(x, ops::add(one, x));
+        case Tonemap::aces: {
+            vec num = ops::mul(x, ops::add(ops::mul(ops::set1(ACES_A), x), ops::set1(ACES_B)));
+            vec den = ops::add(ops::mul(x, ops::add(ops::mul(ops::set1(ACES_C), x),
+                                                    ops::set1(ACES_D))),
+                               ops::set1(ACES_E));
+            return ops::div(num, den);
+        }
+        default: return x;
+        }
+    };
+    auto encode = [&](vec x) {
+        if (p.encoding == DisplayEncoding::gamma2) return ops::sqrt(x);
+        vec s1 = ops::sqrt(x), s2 = ops::sqrt(s1), s3 = ops::sqrt(s2);
+        vec curve = ops::sub(ops::sub(ops::add(ops::mul(ops::set1(0.662002687), s1),
+                                               ops::mul(ops::set1(0.684122060), s2)),
+                                      ops::mul(ops::set1(0.323583601), s3)),
+                             ops::mul(ops::set1(0.0225411470), x));
+        return ops::select(ops::le(x, ops::set1(SRGB_LINEAR_MAX)),
+                           ops::mul(ops::set1(12.92), x), curve);
+    };
+
+    int base = 0;
+    for (; base + W <= n; base += W) {
+        vec inv = scale;
+        if (count) {
+            vec c = ops::loadu(count + base);
+            inv = ops::select(ops::lt(zero, c), ops::div(scale, c), zero);
+        }
+        const scalar* src = accum + 3 * size_t(base);
+        for (int k = 0; k < W; ++k) {
+            lanes[0][k] = src[3 * k];
+            lanes[1][k] = src[3 * k + 1];
+            lanes[2][k] = src[3 * k + 2];
+        }
+        for (int ch = 0; ch < 3; ++ch) {
+            // max(NaN, 0) is 0, as in display_value8
+            vec v = ops::max(ops::mul(ops::loadu(lanes[ch]), inv), zero);
+            v = encode(tonemap(v));
+            v = ops::select(ops::lt(v, top), v, top);
+            ops::storeu(lanes[ch], ops::mul(v, to8));
+        }
+        for (int k = 0; k < W; ++k) {
+            uint32_t r = static_cast<uint32_t>(lanes[0][k]);
+            uint32_t g = static_cast<uint32_t>(lanes[1][k]);
+            uint32_t b = static_cast<uint32_t>(lanes[2][k]);
+            if constexpr (ARGB) {
+                static_cast<uint32_t*>(out)[base + k] = (255u << 24) | (r << 16) | (g << 8) | b;
+            } else {
+                uint8_t* px = static_cast<uint8_t*>(out) + 3 * size_t(base + k);
+                px[0] = static_cast<uint8_t>(r);
+                px[1] = static_cast<uint8_t>(g);
+                px[2] = static_cast<uint8_t>(b);
+            }
+        }
+    }
+    if (base < n) {
+        void* rest = ARGB ? static_cast<void*>(static_cast<uint32_t*>(out) + base)
+                          : static_cast<void*>(static_cast<uint8_t*>(out) + 3 * size_t(base));
+        simd_scalar::encode_display<ARGB>(accum + 3 * size_t(base), count ? count + base : nullptr,
+                                          n - base, p, rest);
+    }
+}
@@ -0,0 +1,215 @@
+#pragma once
+#include "simd.h"
+#include "sphere.h"
+#include "rect.h"
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+// One-ray-vs-many-primitives SIMD kernels. Each primitive_array keeps a
+// structure-of-arrays copy of its items in BVH leaf order; a leaf slice is
+// tested 2/4/8 doubles or 4/8/16 floats at a time (SSE4.1/AVX2/AVX-512,
+// following `real`) and the winner is re-run through the scalar hit() to fill the hit_record.
+
+#if PT_HAVE_X86_SIMD
+namespace simd_sse4 {
+PT_SIMD_TARGET_BEGIN("sse4.1")
+using ops = std::conditional_t<std::is_same_v<real, float>, sse4_f32_ops, sse4_f64_ops>;
+#include "simd_intersect.inl"
+PT_SIMD_TARGET_END()
+}
+
+namespace simd_avx2 {
+PT_SIMD_TARGET_BEGIN("avx2")
+using ops = std::conditional_t<std::is_same_v<real, float>, avx2_f32_ops, avx2_f64_ops>;
+#include "simd_intersect.inl"
+PT_SIMD_TARGET_END()
+}
+
+namespace simd_avx512 {
+PT_SIMD_TARGET_BEGIN("avx512f")
+using ops = std::conditional_t<std::is_same_v<real, float>, avx512_f32_ops, avx512_f64_ops>;
+#include "simd_intersect.inl"
+PT_SIMD_TARGET_END()
+}
+#endif
+
+struct sphere_soa {
+    std::vector<real> cx, cy, cz, radius;
+
+    void assign(const std::vector<sphere>& items) {
+        size_t n = items.size() + SIMD_MAX_WIDTH;
+        cx.assign(n, real(0));
+        cy.assign(n, real(0));
+        cz.assign(n, real(0));
+        radius.assign(n, real(0));
+        for (size_t i = 0; i < items.size(); ++i) {
+            cx[i] = items[i].center.x();
+            cy[i] = items[i].center.y();
+            cz[i] = items[i].center.z();
+            radius[i] = items[i].radius;
+        }
+    }
+
+    // Index of the closest hit among [first, first + count), or -1
+    int closest(simd_isa isa, int first, int count, const ray& r,
+                real t_min, real t_max, real& t_hit) const {
+#if PT_HAVE_X86_SIMD
+        vec3 o = r.origin();
+        vec3 d = r.direction();
+        int i = -1;
+        switch (isa) {
+        case simd_isa::avx512:
+            i = simd_avx512::closest_spheres(&cx[first], &cy[first], &cz[first], &radius[first],
+                                             count, o.e, d.e, t_min, t_max, t_hit);
+            break;
+        case simd_isa::avx2:
+            i = simd_avx2::closest_spheres(&cx[first], &cy[first], &cz[first], &radius[first],
+                                           count, o.e, d.e, t_min, t_max, t_hit);
+            break;
+        default:
+            i = simd_sse4::closest_spheres(&cx[first], &cy[first], &cz[first], &radius[first],
+                                           count, o.e, d.e, t_min, t_max, t_hit);
+            break;
+        }
+        return i < 0 ? -1 : first + i;
+#else
+        (void)isa; (void)first; (void)count; (void)r; (void)t_min; (void)t_max; (void)t_hit;
+        return -1;
+#endif
+    }
+
+    // Any hit in [t_min, t_max] among [first, first + count)
+    bool occluded(simd_isa isa, int first, int count,
+                  const ray& r, real t_min, real t_max) const {
+#if PT_HAVE_X86_SIMD
+        vec3 o = r.origin();
+        vec3 d = r.direction();
+        switch (isa) {
+        case simd_isa::avx512:
+            return simd_avx512::any_sphere(&cx[first], &cy[first], &cz[first], &radius[first],
+                                           count, o.e, d.e, t_min, t_max);
+        case simd_isa::avx2:
+            return simd_avx2::any_sphere(&cx[first], &cy[first], &cz[first], &radius[first],
+                                         count, o.e, d.e, t_min, t_max);
+        default:
+            return simd_sse4::any_sphere(&cx[first], &cy[first], &cz[first], &radius[first],
+                                         count, o.e, d.e, t_min, t_max);
+        }
+#else
+        (void)isa; (void)first; (void)count; (void)r; (void)t_min; (void)t_max;
+        return false;
+#endif
+    }
+};
+
+// Rect in the plane coordinate[Plane] == k, spanning [a0,a1] along axis A
+// and [b0,b1] along axis B
+template <int Plane, int A, int B>
+struct rect_soa {
+    std::vector<real> a0, a1, b0, b1, k;
+
+    void resize(size_t count) {
+        size_t n = count + SIMD_MAX_WIDTH;
+        a0.assign(n, real(0));
+        a1.assign(n, real(0));
+        b0.assign(n, real(0));
+        b1.assign(n, real(0));
+        k.assign(n, real(0));
+    }
+
+    int closest(simd_isa isa, int first, int count, const ray& r,
+                real t_min, real t_max, real& t_hit) const {
+#if PT_HAVE_X86_SIMD
+        vec3 o = r.origin();
+        vec3 d = r.direction();
+        int i = -1;
+        switch (isa) {
+        case simd_isa::avx512:
+            i = simd_avx512::closest_rects(&a0[first], &a1[first], &b0[first], &b1[first],
+                                           &k[first], count, o[Plane], d[Plane], o[A], d[A],
+                                           o[B], d[B], t_min, t_max, t_hit);
+            break;
+        case simd_isa::avx2:
+            i = simd_avx2::closest_rects(&a0[first], &a1[first], &b0[first], &b1[first],
+                                         &k[first], count, o[Plane], d[Plane], o[A], d[A],
+                                         o[B], d[B], t_min, t_max, t_hit);
+            break;
+        default:
+            i = simd_sse4::closest_rects(&a0[first], &a1[first], &b0[first], &b1[first],
+                                         &k[first], count, o[Plane], d[Plane], o[A], d[A],
+                                         o[B], d[B], t_min, t_max, t_hit);
+            break;
+        }
+        return i < 0 ? -1 : first + i;
+#else
+        (void)isa; (void)first; (void)count; (void)r; (void)t_min; (void)t_max; (void)t_hit;
+        return -1;
+#endif
+    }
+
+    bool occluded(simd_isa isa, int first, int count,
+                  const ray& r, real t_min, real t_max) const {
+#if PT_HAVE_X86_SIMD
+        vec3 o = r.origin();
+        vec3 d = r.direction();
+        switch (isa) {
+        case simd_isa::avx512:
+            return simd_avx512::any_rect(&a0[first], &a1[first], &b0[first], &b1[first],
+                                         &k[first], count, o[Plane], d[Plane],
+                                         o[A], d[A], o[B], d[B], t_min, t_max);
+        case simd_isa::avx2:
+            return simd_avx2::any_rect(&a0[first], &a1[first], &b0[first], &b1[first],
+                                       &k[first], count, o[Plane], d[Plane],
+                                       o[A], d[A], o[B], d[B], t_min, t_max);
+        default:
+            return simd_sse4::any_rect(&a0[first], &a1[first], &b0[first], &b1[first],
+                                       &k[first], count, o[Plane], d[Plane],
+                                       o[A], d[A], o[B], d[B], t_min, t_max);
+        }
+#else
+        (void)isa; (void)first; (void)count; (void)r; (void)t_min; (void)t_max;
+        return false;
+#endif
+    }
+};
+
+struct xy_rect_soa : rect_soa<2, 0, 1> {
+    void assign(const std::vector<xy_rect>& items) {
+        resize(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            a0[i] = items[i].x0; a1[i] = items[i].x1;
+            b0[i] = items[i].y0; b1[i] = items[i].y1;
+            k[i] = items[i].k;
+        }
+    }
+};
+
+struct xz_rect_soa : rect_soa<1, 0, 2> {
+    void assign(const std::vector<xz_rect>& items) {
+        resize(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            a0[i] = items[i].x0; a1[i] = items[i].x1;
+            b0[i] = items[i].z0; b1[i] = items[i].z1;
+            k[i] = items[i].k;
+        }
+    }
+};
+
+struct yz_rect_soa : rect_soa<0, 1, 2> {
+    void assign(const std::vector<yz_rect>& items) {
+        resize(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            a0[i] = items[i].y0; a1[i] = items[i].y1;
+            b0[i] = items[i].z0; b1[i] = items[i].z1;
+            k[i] = items[i].k;
+        }
+    }
+};
+
+// SoA layout used for each primitive kind
+template <typename Prim> struct soa_layout;
+template <> struct soa_layout<sphere>  { using type = sphere_soa; };
+template <> struct soa_layout<xy_rect> { using type = xy_rect_soa; };
+template <> struct soa_layout<xz_rect> { using type = xz_rect_soa; };
+template <> struct soa_layout<yz_rect> { using type = yz_rect_soa; };
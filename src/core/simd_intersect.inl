@@ -0,0 +1,205 @@
+// simd_intersect.inl -- ISA-generic intersection kernels.
+//
+// Included by simd_intersect.h once per ISA, inside a namespace that defines
+// `ops` and between PT_SIMD_TARGET_BEGIN/END. Arithmetic mirrors the scalar
+// sphere::hit / *_rect::hit operation for operation (no FMA contraction), so
+// the t values agree with the scalar path.
+
+// Closest sphere in [0, count) whose root lies in [t_min, t_max].
+// Returns its index and sets t_hit, or returns -1.
+inline int closest_spheres(const ops::scalar* cx, const ops::scalar* cy, const ops::scalar* cz,
+                           const ops::scalar* rad, int count,
+                           const ops::scalar o[3], const ops::scalar d[3],
+                           ops::scalar t_min, ops::scalar t_max, ops::scalar& t_hit)
+{
+    using scalar = ops::scalar;
+    using vec = ops::vec;
+    using mask = ops::mask;
+    constexpr int W = ops::width;
+
+    const vec ox = ops::set1(o[0]), oy = ops::set1(o[1]), oz = ops::set1(o[2]);
+    const vec dx = ops::set1(d[0]), dy = ops::set1(d[1]), dz = ops::set1(d[2]);
+    const vec a = ops::set1(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+    const vec zero = ops::set1(0);
+    const vec inf = ops::set1(std::numeric_limits<scalar>::infinity());
+    const vec tmin = ops::set1(t_min);
+    const vec lane = ops::iota();
+
+    int best = -1;
+    scalar best_t = t_max;
+
+    for (int base = 0; base < count; base += W) {
+        vec ocx = ops::sub(ox, ops::loadu(cx + base));
+        vec ocy = ops::sub(oy, ops::loadu(cy + base));
+        vec ocz = ops::sub(oz, ops::loadu(cz + base));
+        vec r = ops::loadu(rad + base);
+
+        vec half_b = ops::add(ops::add(ops::mul(ocx, dx), ops::mul(ocy, dy)), ops::mul(ocz, dz));
+        vec c = ops::sub(ops::add(ops::add(ops::mul(ocx, ocx), ops::mul(ocy, ocy)),
+                                  ops::mul(ocz, ocz)),
+                         ops::mul(r, r));
+        vec disc = ops::sub(ops::mul(half_b, half_b), ops::mul(a, c));
+
+        mask live = ops::mask_and(ops::ge(disc, zero),
+                                  ops::lt(lane, ops::set1(static_cast<scalar>(count - base))));
+        if (!ops::any(live)) continue;
+
+        vec sqrtd = ops::sqrt(ops::max(disc, zero));
+        vec neg_half_b = ops::sub(zero, half_b);
+        vec root0 = ops::div(ops::sub(neg_half_b, sqrtd), a);
+        vec root1 = ops::div(ops::add(neg_half_b, sqrtd), a);
+
+        vec tmax = ops::set1(best_t);
+        mask in0 = ops::mask_and(ops::ge(root0, tmin), ops::le(root0, tmax));
+        mask in1 = ops::mask_and(ops::ge(root1, tmin), ops::le(root1, tmax));
+        mask ok = ops::mask_and(live, ops::mask_or(in0, in1));
+        if (!ops::any(ok)) continue;
+
+        vec t = ops::select(ok, ops::select(in0, root0, root1), inf);
+        scalar lanes[W];
+        ops::storeu(lanes, t);
+        for (int l = 0; l < W; ++l) {
+            if (lanes[l] < best_t || (best < 0 && lanes[l] == best_t)) {
+                best_t = lanes[l];
+                best = base + l;
+            }
+        }
+    }
+
+    t_hit = best_t;
+    return best;
+}
+
+// Closest axis-aligned rect in [0, count). The plane lies at `k` along the
+// normal axis (ray component op/dp) and spans [a0,a1] x [b0,b1] along the
+// two in-plane axes (components oa/da and ob/db).
+inline int closest_rects(const ops::scalar* a0, const ops::scalar* a1,
+                         const ops::scalar* b0, const ops::scalar* b1,
+                         const ops::scalar* k, int count,
+                         ops::scalar op, ops::scalar dp, ops::scalar oa, ops::scalar da,
+                         ops::scalar ob, ops::scalar db,
+                         ops::scalar t_min, ops::scalar t_max, ops::scalar& t_hit)
+{
+    using scalar = ops::scalar;
+    using vec = ops::vec;
+    using mask = ops::mask;
+    constexpr int W = ops::width;
+
+    const vec vop = ops::set1(op), vdp = ops::set1(dp);
+    const vec voa = ops::set1(oa), vda = ops::set1(da);
+    const vec vob = ops::set1(ob), vdb = ops::set1(db);
+    const vec inf = ops::set1(std::numeric_limits<scalar>::infinity());
+    const vec tmin = ops::set1(t_min);
+    const vec lane = ops::iota();
+
+    int best = -1;
+    scalar best_t = t_max;
+
+    for (int base = 0; base < count; base += W) {
+        vec t = ops::div(ops::sub(ops::loadu(k + base), vop), vdp);
+        vec x = ops::add(voa, ops::mul(t, vda));
+        vec y = ops::add(vob, ops::mul(t, vdb));
+
+        mask ok = ops::mask_and(ops::ge(t, tmin), ops::le(t, ops::set1(best_t)));
+        ok = ops::mask_and(ok, ops::lt(lane, ops::set1(static_cast<scalar>(count - base))));
+        ok = ops::mask_and(ok, ops::mask_and(ops::ge(x, ops::loadu(a0 + base)),
+                                             ops::le(x, ops::loadu(a1 + base))));
+        ok = ops::mask_and(ok, ops::mask_and(ops::ge(y, ops::loadu(b0 + base)),
+                                             ops::le(y, ops::loadu(b1 + base))));
+        if (!ops::any(ok)) continue;
+
+        t = ops::select(ok, t, inf);
+        scalar lanes[W];
+        ops::storeu(lanes, t);
+        for (int l = 0; l < W; ++l) {
+            if (lanes[l] < best_t || (best < 0 && lanes[l] == best_t)) {
+                best_t = lanes[l];
+                best = base + l;
+            }
+        }
+    }
+
+    t_hit = best_t;
+    return best;
+}
+
+// Any-hit variants for shadow rays: true as soon as one lane has a hit in
+// [t_min, t_max].
+inline bool any_sphere(const ops::scalar* cx, const ops::scalar* cy, const ops::scalar* cz,
+                       const ops::scalar* rad, int count,
+                       const ops::scalar o[3], const ops::scalar d[3],
+                       ops::scalar t_min, ops::scalar t_max)
+{
+    using scalar = ops::scalar;
+    using vec = ops::vec;
+    using mask = ops::mask;
+    constexpr int W = ops::width;
+
+    const vec ox = ops::set1(o[0]), oy = ops::set1(o[1]), oz = ops::set1(o[2]);
+    const vec dx = ops::set1(d[0]), dy = ops::set1(d[1]), dz = ops::set1(d[2]);
+    const vec a = ops::set1(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+    const vec zero = ops::set1(0);
+    const vec tmin = ops::set1(t_min), tmax = ops::set1(t_max);
+    const vec lane = ops::iota();
+
+    for (int base = 0; base < count; base += W) {
+        vec ocx = ops::sub(ox, ops::loadu(cx + base));
+        vec ocy = ops::sub(oy, ops::loadu(cy + base));
+        vec ocz = ops::sub(oz, ops::loadu(cz + base));
+        vec r = ops::loadu(rad + base);
+
+        vec half_b = ops::add(ops::add(ops::mul(ocx, dx), ops::mul(ocy, dy)), ops::mul(ocz, dz));
+        vec c = ops::sub(ops::add(ops::add(ops::mul(ocx, ocx), ops::mul(ocy, ocy)),
+                                  ops::mul(ocz, ocz)),
+                         ops::mul(r, r));
+        vec disc = ops::sub(ops::mul(half_b, half_b), ops::mul(a, c));
+
+        mask live = ops::mask_and(ops::ge(disc, zero),
+                                  ops::lt(lane, ops::set1(static_cast<scalar>(count - base))));
+        if (!ops::any(live)) continue;
+
+        vec sqrtd = ops::sqrt(ops::max(disc, zero));
+        vec neg_half_b = ops::sub(zero, half_b);
+        vec root0 = ops::div(ops::sub(neg_half_b, sqrtd), a);
+        vec root1 = ops::div(ops::add(neg_half_b, sqrtd), a);
+
+        mask in0 = ops::mask_and(ops::ge(root0, tmin), ops::le(root0, tmax));
+        mask in1 = ops::mask_and(ops::ge(root1, tmin), ops::le(root1, tmax));
+        if (ops::any(ops::mask_and(live, ops::mask_or(in0, in1)))) return true;
+    }
+    return false;
+}
+
+inline bool any_rect(const ops::scalar* a0, const ops::scalar* a1,
+                     const ops::scalar* b0, const ops::scalar* b1,
+                     const ops::scalar* k, int count,
+                     ops::scalar op, ops::scalar dp, ops::scalar oa, ops::scalar da,
+                     ops::scalar ob, ops::scalar db,
+                     ops::scalar t_min, ops::scalar t_max)
+{
+    using scalar = ops::scalar;
+    using vec = ops::vec;
+    using mask = ops::mask;
+    constexpr int W = ops::width;
+
+    const vec vop = ops::set1(op), vdp = ops::set1(dp);
+    const vec voa = ops::set1(oa), vda = ops::set1(da);
+    const vec vob = ops::set1(ob), vdb = ops::set1(db);
+    const vec tmin = ops::set1(t_min), tmax = ops::set1(t_max);
+    const vec lane = ops::iota();
+
+    for (int base = 0; base < count; base += W) {
+        vec t = ops::div(ops::sub(ops::loadu(k + base), vop), vdp);
+        vec x = ops::add(voa, ops::mul(t, vda));
+        vec y = ops::add(vob, ops::mul(t, vdb));
+
+        mask ok = ops::mask_and(ops::ge(t, tmin), ops::le(t, tmax));
+        ok = ops::mask_and(ok, ops::lt(lane, ops::set1(static_cast<scalar>(count - base))));
+        ok = ops::mask_and(ok, ops::mask_and(ops::ge(x, ops::loadu(a0 + base)),
+                                             ops::le(x, ops::loadu(a1 + base))));
+        ok = ops::mask_and(ok, ops::mask_and(ops::ge(y, ops::loadu(b0 + base)),
+                                             ops::le(y, ops::loadu(b1 + base))));
+        if (ops::any(ok)) return true;
+    }
+    return false;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "simd.h"
+#include <type_traits>
+
+// Reductions over the SoA per-pixel statistics in metrics.h, dispatched on
+// active_simd_isa() like the intersection kernels.
+
+#if PT_HAVE_X86_SIMD
+namespace simd_sse4 {
+PT_SIMD_TARGET_BEGIN("sse4.1")
+using ops = std::conditional_t<std::is_same_v<real, float>, sse4_f32_ops, sse4_f64_ops>;
+#include "simd_stats.inl"
+PT_SIMD_TARGET_END()
+}
+
+namespace simd_avx2 {
+PT_SIMD_TARGET_BEGIN("avx2")
+using ops = std::conditional_t<std::is_same_v<real, float>, avx2_f32_ops, avx2_f64_ops>;
+#include "simd_stats.inl"
+PT_SIMD_TARGET_END()
+}
+
+namespace simd_avx512 {
+PT_SIMD_TARGET_BEGIN("avx512f")
+using ops = std::conditional_t<std::is_same_v<real, float>, avx512_f32_ops, avx512_f64_ops>;
+#include "simd_stats.inl"
+PT_SIMD_TARGET_END()
+}
+#endif
+
+inline double rel_mse_sum(const real* mean, const real* m2, const real* n,
+                          int count, real eps) {
+#if PT_HAVE_X86_SIMD
+    switch (active_simd_isa()) {
+    case simd_isa::avx512: return simd_avx512::rel_mse_sum(mean, m2, n, count, eps);
+    case simd_isa::avx2:   return simd_avx2::rel_mse_sum(mean, m2, n, count, eps);
+    case simd_isa::sse4:   return simd_sse4::rel_mse_sum(mean, m2, n, count, eps);
+    default: break;
+    }
+#endif
+    double acc = 0.0;
+    for (int i = 0; i < count; ++i) {
+        if (n[i] < 2) continue;
+        real var_mean = m2[i] / (n[i] * (n[i] - 1));
+        acc += var_mean / (mean[i] * mean[i] + eps);
+    }
+    return acc;
+}
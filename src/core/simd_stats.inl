@@ -0,0 +1,36 @@
+// simd_stats.inl -- ISA-generic reductions over per-pixel statistics.
+//
+// Included by simd_stats.h once per ISA, like simd_intersect.inl.
+
+// Sum over [0, count) of Var[mean] / (mean^2 + eps), the estimated relative
+// MSE of each pixel, with Var[mean] = m2 / (n (n - 1)). Pixels with fewer
+// than two samples contribute nothing. Inputs must be readable up to a
+// full vector past count.
+inline double rel_mse_sum(const ops::scalar* mean, const ops::scalar* m2,
+                          const ops::scalar* n, int count, ops::scalar eps)
+{
+    using scalar = ops::scalar;
+    using vec = ops::vec;
+    using mask = ops::mask;
+    constexpr int W = ops::width;
+
+    const vec zero = ops::set1(0);
+    const vec one = ops::set1(1);
+    const vec two = ops::set1(2);
+    const vec veps = ops::set1(eps);
+    const vec lane = ops::iota();
+    vec acc = zero;
+
+    for (int base = 0; base < count; base += W) {
+        vec vn = ops::loadu(n + base);
+        vec vm = ops::loadu(mean + base);
+        mask live = ops::mask_and(ops::ge(vn, two),
+                                  ops::lt(lane, ops::set1(static_cast<scalar>(count - base))));
+        if (!ops::any(live)) continue;
+
+        vec var_mean = ops::div(ops::loadu(m2 + base), ops::mul(vn, ops::sub(vn, one)));
+        vec rel = ops::div(var_mean, ops::add(ops::mul(vm, vm), veps));
+        acc = ops::add(acc, ops::select(live, rel, zero));
+    }
+    return ops::reduce_add(acc);
+}
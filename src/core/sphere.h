@@ -1,17 +1,19 @@
 #pragma once
 #include "hittable.h"
 
-class sphere : public hittable {
+template <typename T>
+class sphere_t {
 public:
-    vec3 center;
-    double radius;
+    vec3_t<T> center;
+    T radius;
     int material_id;
+    int light_id = -1;  // index in the scene's light list, if emissive
 
-    sphere() {}
-    sphere(vec3 cen, double r, int m_id) : center(cen), radius(r), material_id(m_id) {}
+    sphere_t() {}
+    sphere_t(vec3_t<T> cen, T r, int m_id) : center(cen), radius(r), material_id(m_id) {}
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override {
-        vec3 oc = r.origin() - center;
+    bool hit(const ray_t<T>& r, T t_min, T t_max, hit_record_t<T>& rec) const {
+        vec3_t<T> oc = r.origin() - center;
         auto a = r.direction().length_squared();
         auto half_b = dot(oc, r.direction());
         auto c = oc.length_squared() - radius*radius;
@@ -28,10 +30,38 @@ public:
         }
 
         rec.t = root;
-        rec.p = r.at(rec.t);
-        vec3 outward_normal = (rec.p - center) / radius;
+        // Reproject onto the surface so offset_ray_origin starts from an
+        // accurate point
+        vec3_t<T> from_center = r.at(rec.t) - center;
+        rec.p = center + (radius / from_center.length()) * from_center;
+        vec3_t<T> outward_normal = (rec.p - center) / radius;
         rec.set_face_normal(r, outward_normal);
         rec.material_id = material_id;
+        rec.light_id = light_id;
+        return true;
+    }
+
+    // Any root in [t_min, t_max]; no hit point or normal is computed
+    bool occludes(const ray_t<T>& r, T t_min, T t_max) const {
+        vec3_t<T> oc = r.origin() - center;
+        auto a = r.direction().length_squared();
+        auto half_b = dot(oc, r.direction());
+        auto c = oc.length_squared() - radius*radius;
+
+        auto discriminant = half_b*half_b - a*c;
+        if (discriminant < 0) return false;
+        auto sqrtd = std::sqrt(discriminant);
+
+        auto root0 = (-half_b - sqrtd) / a;
+        auto root1 = (-half_b + sqrtd) / a;
+        return (root0 >= t_min && root0 <= t_max) || (root1 >= t_min && root1 <= t_max);
+    }
+
+    bool bounding_box(aabb_t<T>& output_box) const {
+        vec3_t<T> r(radius, radius, radius);
+        output_box = aabb_t<T>(center - r, center + r);
         return true;
     }
 };
+
+using sphere = sphere_t<real>;
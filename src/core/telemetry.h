@@ -0,0 +1,107 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include "path_tracer.h"
+#include "counters.h"
+#include "denoise.h"
+
+// JSON export of the hot-path counters of a run (see counters.h), written
+// next to the output image. Besides the raw counts it derives the figures
+// used to tune max_depth and the roulette probabilities: mean path length,
+// how paths end, and how often NEE samples are wasted.
+
+// foo.ppm -> foo.json
+inline std::string telemetry_path(const std::string& image_path) {
+    size_t slash = image_path.find_last_of('/');
+    size_t dot = image_path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return image_path + ".json";
+    return image_path.substr(0, dot) + ".json";
+}
+
+// c holds the counters of the whole run (summed over ranks for MPI);
+// render_seconds is the wall time they were collected over. denoise, if
+// given, adds the denoiser's cost and benefit.
+inline bool write_telemetry_json(const std::string& path, const PathTracerState& state,
+                                 const CounterBlock& c, double render_seconds, int ranks = 1,
+                                 const DenoiseReport* denoise = nullptr) {
+    auto ratio = [](double a, double b) { return b > 0.0 ? a / b : 0.0; };
+    double camera = double(c[Counter::camera_rays]);
+    double bounce = double(c[Counter::bounce_rays]);
+    double shadow = double(c[Counter::shadow_rays]);
+    double rays = camera + bounce + shadow;
+    double tests = double(c[Counter::sphere_tests]) + double(c[Counter::xy_rect_tests]) +
+                   double(c[Counter::xz_rect_tests]) + double(c[Counter::yz_rect_tests]);
+    double nee = double(c[Counter::nee_samples]);
+
+    std::ofstream out(path);
+    if (!out) return false;
+    out.precision(10);
+    const PathTracerConfig& cfg = state.cfg;
+    out << "{\n"
+        << "  \"counters_enabled\": " << (COUNTERS_ENABLED ? "true" : "false") << ",\n"
+        << "  \"stage_timers_enabled\": " << (STAGE_TIMERS_ENABLED ? "true" : "false") << ",\n"
+        << "  \"real\": \"" << (sizeof(real) == sizeof(float) ? "float32" : "float64") << "\",\n"
+        << "  \"engine\": \"" << (cfg.engine == RenderEngine::wavefront ? "wavefront"
+                                                                        : "megakernel") << "\",\n"
+        << "  \"ranks\": " << ranks << ",\n"
+        << "  \"threads_per_rank\": " << resolve_thread_count(cfg.num_threads) << ",\n"
+        << "  \"iterations\": " << state.iterations << ",\n"
+        << "  \"render_seconds\": " << render_seconds << ",\n"
+        << "  \"config\": {\"width\": " << cfg.image_width << ", \"height\": " << cfg.image_height
+        << ", \"max_depth\": " << cfg.max_depth << ", \"spp_per_iteration\": "
+        << cfg.spp_per_iteration << ", \"adaptive\": " << (cfg.adaptive ? "true" : "false")
+        << ", \"scene\": \"" << scene_name(cfg.scene)
+        << "\", \"lights\": " << state.scene.lights.size() << ", \"light_sampling\": \""
+        << (cfg.light_sampling == LightSampling::power ? "power" : "bvh")
+        << "\", \"direct\": \"" << (cfg.direct_lighting == DirectLighting::mis ? "mis" : "nee")
+        << "\"},\n";
+
+    out << "  \"rays\": {\"camera\": " << camera << ", \"bounce\": " << bounce
+        << ", \"shadow\": " << shadow << ", \"total\": " << rays
+        << ", \"mrays_per_s\": " << ratio(rays, render_seconds) * 1e-6 << "},\n";
+
+    out << "  \"intersection_tests\": {\"sphere\": " << c[Counter::sphere_tests]
+        << ", \"xy_rect\": " << c[Counter::xy_rect_tests]
+        << ", \"xz_rect\": " << c[Counter::xz_rect_tests]
+        << ", \"yz_rect\": " << c[Counter::yz_rect_tests]
+        << ", \"per_ray\": " << ratio(tests, rays) << "},\n";
+
+    // Every path starts with one camera ray; its length is the number of
+    // closest-hit segments it traced
+    out << "  \"paths\": {\"count\": " << camera
+        << ", \"mean_length\": " << ratio(camera + bounce, camera)
+        << ", \"escaped\": " << c[Counter::escaped_paths]
+        << ", \"light_hits\": " << c[Counter::light_hits]
+        << ", \"rr_terminations\": " << c[Counter::rr_terminations]
+        << ", \"max_depth_terminations\": " << c[Counter::max_depth_terminations] << "},\n";
+
+    out << "  \"nee\": {\"samples\": " << nee
+        << ", \"rejected_backfacing\": " << c[Counter::nee_backfacing]
+        << ", \"rejected_occluded\": " << c[Counter::nee_occluded]
+        << ", \"contributing_fraction\": "
+        << ratio(nee - double(c[Counter::nee_backfacing]) - double(c[Counter::nee_occluded]), nee)
+        << "},\n";
+
+    // Thread-seconds per stage, summed over every thread (and rank)
+    out << "  \"stage_seconds\": {";
+    double tps = STAGE_TIMERS_ENABLED ? ticks_per_second() : 1.0;
+    for (int s = 0; s < NUM_STAGES; ++s) {
+        Stage stage = static_cast<Stage>(s);
+        out << (s ? ", " : "") << "\"" << stage_name(stage) << "\": " << double(c[stage]) / tps;
+    }
+    out << "}";
+
+    if (denoise) {
+        out << ",\n  \"denoise\": {\"filter_ms\": " << denoise->filter_ms;
+        if (denoise->has_reference)
+            out << ", \"mse_noisy\": " << denoise->mse_noisy
+                << ", \"mse_denoised\": " << denoise->mse_denoised
+                << ", \"mse_removed_per_ms\": " << denoise->mse_removed_per_ms()
+                << ", \"display_mse_noisy\": " << denoise->display_mse_noisy
+                << ", \"display_mse_denoised\": " << denoise->display_mse_denoised;
+        out << "}";
+    }
+    out << "\n}\n";
+    return bool(out);
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "vec3.h"
+#include "profiler.h"
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1)
+struct Tile {
+    int x0, y0, x1, y1;
+};
+
+inline std::vector<Tile> make_tiles(int width, int height, int tile_size) {
+    tile_size = std::max(1, tile_size);
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += tile_size) {
+        for (int x = 0; x < width; x += tile_size) {
+            tiles.push_back({x, y,
+                             std::min(x + tile_size, width),
+                             std::min(y + tile_size, height)});
+        }
+    }
+    return tiles;
+}
+
+inline int resolve_thread_count(int requested) {
+    if (requested > 0) return requested;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw > 0 ? static_cast<int>(hw) : 1;
+}
+
+// Persistent work-stealing pool over tile indices.
+//
+// Each worker owns a contiguous [begin, end) range of tiles packed into a
+// single atomic word. The owner pops from the front; an idle worker steals
+// the back half of a victim's range with one CAS on the same word, so no
+// locks are taken while tiles are being handed out. The calling thread acts
+// as worker 0, so a pool of one thread renders inline.
+class TileScheduler {
+public:
+    using TileFn = std::function<void(int tile, int worker)>;
+
+    explicit TileScheduler(int num_threads)
+        : num_workers_(std::max(1, num_threads)),
+          ranges_(new WorkRange[num_workers_])
+    {
+        uint32_t pool_seed = std::random_device{}();
+        for (int w = 1; w < num_workers_; ++w) {
+            threads_.emplace_back([this, w, pool_seed] {
+                std::seed_seq seq{pool_seed, static_cast<uint32_t>(w)};
+                seed_random(seq);
+                set_profile_thread_name("worker " + std::to_string(w));
+                worker_loop(w);
+            });
+        }
+    }
+
+    ~TileScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        start_cv_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+    TileScheduler(const TileScheduler&) = delete;
+    TileScheduler& operator=(const TileScheduler&) = delete;
+
+    int num_threads() const { return num_workers_; }
+
+    // Calls fn(tile, worker) once for every tile in [0, num_tiles) and
+    // returns when all of them have completed.
+    void run(int num_tiles, const TileFn& fn) {
+        for (int w = 0; w < num_workers_; ++w) {
+            uint32_t b = static_cast<uint32_t>((int64_t)num_tiles * w / num_workers_);
+            uint32_t e = static_cast<uint32_t>((int64_t)num_tiles * (w + 1) / num_workers_);
+            ranges_[w].packed.store(pack(b, e), std::memory_order_relaxed);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            job_ = &fn;
+            active_ = num_workers_ - 1;
+            ++generation_;
+        }
+        start_cv_.notify_all();
+
+        drain(0, fn);
+
+        std::unique_lock<std::mutex> lock(mtx_);
+        done_cv_.wait(lock, [this] { return active_ == 0; });
+        job_ = nullptr;
+    }
+
+private:
+    struct alignas(64) WorkRange {
+        std::atomic<uint64_t> packed{0};
+    };
+
+    static uint64_t pack(uint32_t b, uint32_t e) {
+        return (static_cast<uint64_t>(b) << 32) | e;
+    }
+    static uint32_t range_begin(uint64_t r) { return static_cast<uint32_t>(r >> 32); }
+    static uint32_t range_end(uint64_t r) { return static_cast<uint32_t>(r); }
+
+    void worker_loop(int worker) {
+        uint64_t seen = 0;
+        while (true) {
+            const TileFn* fn;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                start_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+                fn = job_;
+            }
+
+            drain(worker, *fn);
+
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (--active_ == 0) done_cv_.notify_one();
+            }
+        }
+    }
+
+    void drain(int worker, const TileFn& fn) {
+        int tile;
+        while (pop(worker, tile) || steal(worker, tile)) {
+            fn(tile, worker);
+        }
+    }
+
+    bool pop(int worker, int& tile) {
+        std::atomic<uint64_t>& slot = ranges_[worker].packed;
+        uint64_t r = slot.load(std::memory_order_acquire);
+        while (range_begin(r) < range_end(r)) {
+            if (slot.compare_exchange_weak(r, pack(range_begin(r) + 1, range_end(r)),
+                                           std::memory_order_acq_rel)) {
+                tile = static_cast<int>(range_begin(r));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool steal(int thief, int& tile) {
+        for (int k = 1; k < num_workers_; ++k) {
+            std::atomic<uint64_t>& slot = ranges_[(thief + k) % num_workers_].packed;
+            uint64_t r = slot.load(std::memory_order_acquire);
+            while (range_begin(r) < range_end(r)) {
+                uint32_t b = range_begin(r);
+                uint32_t e = range_end(r);
+                uint32_t take = (e - b + 1) / 2;
+                if (slot.compare_exchange_weak(r, pack(b, e - take),
+                                               std::memory_order_acq_rel)) {
+                    // Keep the first stolen tile, publish the rest as our own
+                    // range so other idle workers can steal from it in turn.
+                    uint32_t s = e - take;
+                    ranges_[thief].packed.store(pack(s + 1, e), std::memory_order_release);
+                    tile = static_cast<int>(s);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    int num_workers_;
+    std::unique_ptr<WorkRange[]> ranges_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mtx_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    uint64_t generation_ = 0;
+    int active_ = 0;
+    const TileFn* job_ = nullptr;
+    bool stop_ = false;
+};
+
+// Calls fn(begin, end) over [0, n) split into pieces of at least min_piece
+// items, on pool's workers when that gives more than one piece; pool may be
+// null (run inline)
+template <typename Fn>
+inline void parallel_for_ranges(TileScheduler* pool, int n, int min_piece, Fn&& fn) {
+    int pieces = pool ? std::min(4 * pool->num_threads(), n / std::max(1, min_piece)) : 1;
+    if (pieces <= 1 || pool->num_threads() == 1) {
+        if (n > 0) fn(0, n);
+        return;
+    }
+    pool->run(pieces, [&](int k, int) {
+        fn(static_cast<int>(int64_t(n) * k / pieces),
+           static_cast<int>(int64_t(n) * (k + 1) / pieces));
+    });
+}
@@ -1,101 +1,143 @@
 #pragma once
 #include <cmath>
 #include <iostream>
+#include "config.h"
 
-class vec3 {
+template <typename T>
+class vec3_t {
 public:
-    double e[3];
+    using scalar_type = T;
+    T e[3];
 
-    vec3() : e{0,0,0} {}
-    vec3(double e0, double e1, double e2) : e{e0,e1,e2} {}
+    vec3_t() : e{0,0,0} {}
+    vec3_t(T e0, T e1, T e2) : e{e0,e1,e2} {}
 
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+    // Explicit conversion between precisions
+    template <typename U>
+    explicit vec3_t(const vec3_t<U>& v)
+        : e{static_cast<T>(v.e[0]), static_cast<T>(v.e[1]), static_cast<T>(v.e[2])} {}
 
-    vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-    double operator[](int i) const { return e[i]; }
-    double& operator[](int i) { return e[i]; }
+    T x() const { return e[0]; }
+    T y() const { return e[1]; }
+    T z() const { return e[2]; }
 
-    vec3& operator+=(const vec3 &v) {
+    vec3_t operator-() const { return vec3_t(-e[0], -e[1], -e[2]); }
+    T operator[](int i) const { return e[i]; }
+    T& operator[](int i) { return e[i]; }
+
+    vec3_t& operator+=(const vec3_t &v) {
         e[0] += v.e[0]; e[1] += v.e[1]; e[2] += v.e[2];
         return *this;
     }
 
-    vec3& operator*=(double t) {
+    vec3_t& operator*=(T t) {
         e[0] *= t; e[1] *= t; e[2] *= t;
         return *this;
     }
 
-    vec3& operator/=(double t) {
-        return *this *= 1.0/t;
+    vec3_t& operator/=(T t) {
+        return *this *= T(1)/t;
     }
 
-    double length() const {
+    T length() const {
         return std::sqrt(length_squared());
     }
 
-    double length_squared() const {
+    T length_squared() const {
         return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
     }
 
-    static vec3 random(double min = 0.0, double max = 1.0);
+    static vec3_t random(double min = 0.0, double max = 1.0);
 };
 
-inline vec3 operator+(const vec3 &u, const vec3 &v) {
-    return vec3(u.x()+v.x(), u.y()+v.y(), u.z()+v.z());
+using vec3 = vec3_t<real>;
+
+// Scalar operands are taken in a non-deduced context so that literals such
+// as 0.5 * v work for every precision.
+template <typename T>
+using vec3_scalar = typename vec3_t<T>::scalar_type;
+
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.x()+v.x(), u.y()+v.y(), u.z()+v.z());
 }
 
-inline vec3 operator-(const vec3 &u, const vec3 &v) {
-    return vec3(u.x()-v.x(), u.y()-v.y(), u.z()-v.z());
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.x()-v.x(), u.y()-v.y(), u.z()-v.z());
 }
 
-inline vec3 operator*(const vec3 &u, const vec3 &v) {
-    return vec3(u.x()*v.x(), u.y()*v.y(), u.z()*v.z());
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.x()*v.x(), u.y()*v.y(), u.z()*v.z());
 }
 
-inline vec3 operator*(double t, const vec3 &v) {
-    return vec3(t*v.x(), t*v.y(), t*v.z());
+template <typename T>
+inline vec3_t<T> operator*(vec3_scalar<T> t, const vec3_t<T> &v) {
+    return vec3_t<T>(t*v.x(), t*v.y(), t*v.z());
 }
 
-inline vec3 operator*(const vec3 &v, double t) {
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &v, vec3_scalar<T> t) {
     return t * v;
 }
 
-inline vec3 operator/(const vec3 &v, double t) {
-    return (1.0/t) * v;
+template <typename T>
+inline vec3_t<T> operator/(const vec3_t<T> &v, vec3_scalar<T> t) {
+    return (T(1)/t) * v;
 }
 
-inline double dot(const vec3 &u, const vec3 &v) {
+template <typename T>
+inline T dot(const vec3_t<T> &u, const vec3_t<T> &v) {
     return u.x()*v.x() + u.y()*v.y() + u.z()*v.z();
 }
 
-inline vec3 cross(const vec3 &u, const vec3 &v) {
-    return vec3(
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(
         u.y()*v.z() - u.z()*v.y(),
         u.z()*v.x() - u.x()*v.z(),
         u.x()*v.y() - u.y()*v.x()
     );
 }
 
-inline vec3 unit_vector(vec3 v) {
+template <typename T>
+inline vec3_t<T> unit_vector(vec3_t<T> v) {
     return v / v.length();
 }
 
 // helpers //
 
 #include <random>
+#include "rng.h"
+
+inline pcg32& random_engine() {
+    static thread_local pcg32 gen = [] {
+        std::random_device rd;
+        uint64_t state = (static_cast<uint64_t>(rd()) << 32) | rd();
+        uint64_t stream = (static_cast<uint64_t>(rd()) << 32) | rd();
+        return pcg32(state, stream);
+    }();
+    return gen;
+}
+
+// Reseed the calling thread's generator, e.g. to give each worker its own stream
+inline void seed_random(std::seed_seq& seq) {
+    uint32_t w[4];
+    seq.generate(w, w + 4);
+    random_engine().seed((static_cast<uint64_t>(w[0]) << 32) | w[1],
+                         (static_cast<uint64_t>(w[2]) << 32) | w[3]);
+}
 
 inline double random_double(double min = 0.0, double max = 1.0) {
-    static thread_local std::mt19937 gen(std::random_device{}());
-    std::uniform_real_distribution<double> dist(min, max);
-    return dist(gen);
+    return min + (max - min) * u32_to_unit_double(random_engine().next_u32());
 }
 
-inline vec3 vec3::random(double min, double max) {
-    return vec3(random_double(min,max),
-                random_double(min,max),
-                random_double(min,max));
+template <typename T>
+inline vec3_t<T> vec3_t<T>::random(double min, double max) {
+    return vec3_t<T>(static_cast<T>(random_double(min,max)),
+                     static_cast<T>(random_double(min,max)),
+                     static_cast<T>(random_double(min,max)));
 }
 
 inline vec3 random_in_unit_sphere() {
@@ -114,10 +156,15 @@ inline vec3 reflect(const vec3& v, const vec3& n) {
     return v - 2 * dot(v,n) * n;
 }
 
+// Rec. 709 luminance of a linear RGB colour
+inline real luminance(const vec3& c) {
+    return real(0.2126) * c.x() + real(0.7152) * c.y() + real(0.0722) * c.z();
+}
+
 // helper stuff ends // 
 
 vec3 random_in_unit_sphere();
 vec3 random_unit_vector();
 vec3 reflect(const vec3& v, const vec3& n);
-vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat);
+vec3 refract(const vec3& uv, const vec3& n, real etai_over_etat);
 
@@ -0,0 +1,292 @@
+#pragma once
+#include "config.h"
+#include "camera.h"
+#include "integrator.h"
+#include "metrics.h"
+#include "tile_scheduler.h"
+#include <vector>
+
+// Wavefront path tracing. Instead of recursing per sample, every path of a
+// tile advances one bounce at a time through stages that each run one tight
+// loop over structure-of-arrays queues:
+//
+//   generate -> { extend -> shade -> shadow -> roulette } until no path is left
+//
+// Shade walks the paths binned by material_id so one material's data stays
+// hot. The estimator is the same as ray_color's (shared NEE and roulette
+// helpers from integrator.h), so both engines converge to the same image.
+struct WavefrontQueues {
+    // Active paths
+    std::vector<vec3> origin, direction, throughput;
+    std::vector<int> slot, depth;        // slot: index into radiance
+    std::vector<uint32_t> global_pixel, sample;  // RNG key
+    int count = 0;
+
+    // Vertex each active path's ray left from (see PathVertex); from_specular
+    // is also set for camera rays
+    std::vector<vec3> from_p, from_normal;
+    std::vector<real> from_pdf;
+    std::vector<unsigned char> from_specular;
+
+    // Extend output; hit_material < 0 marks a miss
+    std::vector<vec3> hit_p, hit_normal;
+    std::vector<int> hit_material, hit_light;
+
+    // Shade output consumed by roulette
+    std::vector<vec3> bounce_dir, bounce_weight;
+    std::vector<real> bounce_pdf;
+    std::vector<unsigned char> wants_bounce, bounce_specular;
+
+    // Path indices grouped by material (bin 0 holds misses)
+    std::vector<int> bin_start, order;
+
+    // Shadow queue
+    std::vector<vec3> shadow_origin, shadow_dir, shadow_contrib;
+    std::vector<real> shadow_tmax;
+    std::vector<int> shadow_slot;
+    int shadow_count = 0;
+
+    // Radiance gathered for each sample slot of the current tile, and the
+    // slot's first hit; a pixel's slots are [slot_start[local],
+    // slot_start[local + 1])
+    std::vector<vec3> radiance;
+    std::vector<FirstHit> first_hit;
+    std::vector<int> slot_start;
+
+    void reserve(int paths, int pixels) {
+        if (static_cast<int>(origin.size()) < paths) {
+            for (auto* v : {&origin, &direction, &throughput, &from_p, &from_normal,
+                            &hit_p, &hit_normal, &bounce_dir, &bounce_weight,
+                            &shadow_origin, &shadow_dir, &shadow_contrib})
+                v->resize(paths);
+            for (auto* v : {&slot, &depth, &hit_material, &hit_light, &order, &shadow_slot})
+                v->resize(paths);
+            for (auto* v : {&from_pdf, &bounce_pdf, &shadow_tmax})
+                v->resize(paths);
+            for (auto* v : {&from_specular, &wants_bounce, &bounce_specular})
+                v->resize(paths);
+            global_pixel.resize(paths);
+            sample.resize(paths);
+        }
+        radiance.assign(paths, vec3(0,0,0));
+        first_hit.assign(paths, FirstHit());
+        slot_start.assign(pixels + 1, 0);
+        count = 0;
+        shadow_count = 0;
+    }
+};
+
+inline Sampler path_sampler(const WavefrontQueues& q, int p, const PathTracerConfig& cfg) {
+    Sampler sampler(q.global_pixel[p], q.sample[p], cfg.seed);
+    sampler.bounce = static_cast<uint32_t>(cfg.max_depth - q.depth[p]);
+    return sampler;
+}
+
+inline void wavefront_generate(WavefrontQueues& q, const camera& cam,
+                               const PathTracerConfig& cfg, const Tile& tile,
+                               const ConvergenceStats& stats)
+{
+    int W = cfg.image_width;
+    int H = cfg.image_height;
+    int tw = tile.x1 - tile.x0;
+
+    for (int j = tile.y0; j < tile.y1; ++j) {
+        for (int i = tile.x0; i < tile.x1; ++i) {
+            uint32_t first_sample = stats.first_sample(j*W + i);
+            int spp = stats.sample_budget(j*W + i, cfg.spp_per_iteration, cfg.adaptive_max_spp);
+            int local = (j - tile.y0) * tw + (i - tile.x0);
+            q.slot_start[local] = q.count;
+            for (int s = 0; s < spp; ++s) {
+                Sampler sampler(j*W + i, first_sample + s, cfg.seed);
+                double du, dv;
+                sampler.get2(sample_dim::camera_u, du, dv);
+                double u = (i + du) / (W - 1);
+                double v = (j + dv) / (H - 1);
+                ray r = cam.get_ray(u, 1.0 - v);
+                int p = q.count++;
+                q.global_pixel[p] = sampler.pixel;
+                q.sample[p] = sampler.sample;
+                q.origin[p] = r.origin();
+                q.direction[p] = r.direction();
+                q.throughput[p] = vec3(1,1,1);
+                q.from_specular[p] = 1;
+                q.slot[p] = p;
+                q.depth[p] = cfg.max_depth;
+            }
+        }
+    }
+}
+
+// Closest-hit query for every active path; camera rays also record their
+// slot's first hit
+inline void wavefront_extend(WavefrontQueues& q, const Scene& scene, bool camera_rays) {
+    for (int p = 0; p < q.count; ++p) {
+        hit_record rec;
+        ray r(q.origin[p], q.direction[p]);
+        if (scene.world.hit(r, RAY_T_MIN, RAY_T_MAX, rec)) {
+            q.hit_p[p] = rec.p;
+            q.hit_normal[p] = rec.normal;
+            q.hit_material[p] = rec.material_id;
+            q.hit_light[p] = rec.light_id;
+            if (camera_rays)
+                q.first_hit[q.slot[p]] = first_hit_of(r, rec, scene.materials[rec.material_id]);
+        } else {
+            q.hit_material[p] = -1;
+        }
+    }
+}
+
+// Counting sort of path indices by material id
+inline void wavefront_bin_by_material(WavefrontQueues& q, int num_materials) {
+    q.bin_start.assign(num_materials + 2, 0);
+    for (int p = 0; p < q.count; ++p)
+        q.bin_start[q.hit_material[p] + 2]++;
+    for (int b = 1; b < num_materials + 2; ++b)
+        q.bin_start[b] += q.bin_start[b-1];
+    for (int p = 0; p < q.count; ++p)
+        q.order[q.bin_start[q.hit_material[p] + 1]++] = p;
+}
+
+// Emission, light sampling and BSDF sampling, one material bin at a time
+inline void wavefront_shade(WavefrontQueues& q, const Scene& scene,
+                            const PathTracerConfig& cfg) {
+    q.shadow_count = 0;
+    for (int k = 0; k < q.count; ++k) {
+        int p = q.order[k];
+        q.wants_bounce[p] = 0;
+        if (q.hit_material[p] < 0) {
+            count_event(Counter::escaped_paths);
+            continue;
+        }
+
+        const Material& mat = scene.materials[q.hit_material[p]];
+        if (is_emissive(mat)) {
+            count_event(Counter::light_hits);
+            PathVertex from{q.from_p[p], q.from_normal[p], q.origin[p], q.from_pdf[p],
+                            q.from_specular[p] != 0};
+            q.radiance[q.slot[p]] += q.throughput[p] *
+                emission_at_hit(scene, q.direction[p], q.hit_p[p], q.hit_light[p], mat, &from);
+            continue;
+        }
+
+        hit_record rec;
+        rec.p = q.hit_p[p];
+        rec.normal = q.hit_normal[p];
+        rec.material_id = q.hit_material[p];
+
+        Sampler sampler = path_sampler(q, p, cfg);
+        ShadowQuery sq;
+        if (!mat.mirror &&
+            sample_light(scene, rec, mat, sampler, sq, scene.lights.mis && q.depth[p] > 1)) {
+            int s = q.shadow_count++;
+            q.shadow_origin[s] = sq.r.origin();
+            q.shadow_dir[s] = sq.r.direction();
+            q.shadow_tmax[s] = sq.t_max;
+            q.shadow_contrib[s] = q.throughput[p] * sq.contribution;
+            q.shadow_slot[s] = q.slot[p];
+        }
+
+        BsdfSample bs = sample_bsdf(mat, q.direction[p], rec.normal, sampler);
+        q.bounce_dir[p] = bs.wi;
+        q.bounce_weight[p] = bs.weight;
+        q.bounce_pdf[p] = bs.pdf;
+        q.bounce_specular[p] = bs.specular;
+        q.wants_bounce[p] = 1;
+    }
+}
+
+inline void wavefront_shadow(WavefrontQueues& q, const Scene& scene) {
+    for (int s = 0; s < q.shadow_count; ++s) {
+        ShadowQuery sq{ray(q.shadow_origin[s], q.shadow_dir[s]), q.shadow_tmax[s], vec3()};
+        if (light_visible(scene, sq))
+            q.radiance[q.shadow_slot[s]] += q.shadow_contrib[s];
+    }
+}
+
+// Russian roulette and compaction of the surviving paths into the front of
+// the queue for the next extend pass
+inline void wavefront_roulette(WavefrontQueues& q, const PathTracerConfig& cfg) {
+    int alive = 0;
+    for (int p = 0; p < q.count; ++p) {
+        if (!q.wants_bounce[p]) continue;
+
+        real rr_prob = russian_roulette_prob(q.depth[p]);
+        if (path_sampler(q, p, cfg).get(sample_dim::roulette) > rr_prob) {
+            count_event(Counter::rr_terminations);
+            continue;
+        }
+        if (q.depth[p] - 1 <= 0) {
+            count_event(Counter::max_depth_terminations);
+            continue;
+        }
+
+        q.from_p[alive] = q.hit_p[p];
+        q.from_normal[alive] = q.hit_normal[p];
+        q.from_pdf[alive] = q.bounce_pdf[p];
+        q.from_specular[alive] = q.bounce_specular[p];
+        q.origin[alive] = offset_ray_origin(q.hit_p[p], q.hit_normal[p]);
+        q.direction[alive] = q.bounce_dir[p];
+        q.throughput[alive] = q.throughput[p] * q.bounce_weight[p] * (1 / rr_prob);
+        q.slot[alive] = q.slot[p];
+        q.global_pixel[alive] = q.global_pixel[p];
+        q.sample[alive] = q.sample[p];
+        q.depth[alive] = q.depth[p] - 1;
+        ++alive;
+    }
+    q.count = alive;
+}
+
+// Trace one tile with the wavefront engine, passing each pixel's samples
+// of this pass to sink(idx, batch)
+template <typename Sink>
+inline void wavefront_trace_tile(const Scene& scene, const camera& cam,
+                                 const PathTracerConfig& cfg, const Tile& tile,
+                                 WavefrontQueues& q, const ConvergenceStats& stats,
+                                 Sink&& sink)
+{
+    int tw = tile.x1 - tile.x0;
+    int th = tile.y1 - tile.y0;
+    int max_spp = cfg.adaptive ? std::max(cfg.spp_per_iteration, cfg.adaptive_max_spp)
+                               : cfg.spp_per_iteration;
+    q.reserve(tw * th * max_spp, tw * th);
+
+    if (cfg.max_depth > 0) {
+        StageTimer timer(Stage::generate);
+        wavefront_generate(q, cam, cfg, tile, stats);
+    }
+    q.slot_start[tw * th] = q.count;
+
+    int num_materials = static_cast<int>(scene.materials.size());
+    Counter rays = Counter::camera_rays;
+    while (q.count > 0) {
+        count_event(rays, static_cast<uint64_t>(q.count));
+        {
+            StageTimer timer(Stage::intersect);
+            wavefront_extend(q, scene, rays == Counter::camera_rays);
+        }
+        rays = Counter::bounce_rays;
+        {
+            StageTimer timer(Stage::shade);
+            wavefront_bin_by_material(q, num_materials);
+            wavefront_shade(q, scene, cfg);
+        }
+        {
+            StageTimer timer(Stage::shadow);
+            wavefront_shadow(q, scene);
+        }
+        StageTimer timer(Stage::scatter);
+        wavefront_roulette(q, cfg);
+    }
+
+    StageTimer timer(Stage::accumulate);
+    int W = cfg.image_width;
+    for (int j = tile.y0; j < tile.y1; ++j) {
+        for (int i = tile.x0; i < tile.x1; ++i) {
+            int local = (j - tile.y0) * tw + (i - tile.x0);
+            SampleBatch batch;
+            for (int s = q.slot_start[local]; s < q.slot_start[local + 1]; ++s)
+                batch.add(q.radiance[s], q.first_hit[s]);
+            sink(j*W + i, batch);
+        }
+    }
+}
@@ -1,43 +1,148 @@
+#include <chrono>
 #include <iostream>
-#include <fstream>
+#include <string>
 #include <vector>
 #include "core/path_tracer.h"
 #include "core/metrics.h"
+#include "core/options.h"
+#include "core/checkpoint.h"
+#include "core/telemetry.h"
+#include "core/denoise.h"
 
 int main(int argc, char** argv) {
-    int max_iterations = 256;
-    if (argc > 1) {
-        max_iterations = std::atoi(argv[1]);
+    PathTracerState state = make_default_state();
+    RunOptions opt;
+    opt.max_iterations = 256;
+    if (!parse_options(argc, argv, opt, state.cfg)) return 1;
+    load_scene(state);
+    int max_iterations = opt.max_iterations;
+    if (!opt.profile.empty()) {
+        profiler_start();
+        set_profile_thread_name("main");
     }
 
-    PathTracerState state = make_default_state();
     int W = state.cfg.image_width;
     int H = state.cfg.image_height;
 
-    std::vector<vec3> prev_buffer(W * H, vec3(0,0,0));
+    Checkpoint checkpoint;
+    if (!opt.checkpoint.empty()) {
+        if (!checkpoint.open(opt.checkpoint, state, 0, H, opt.resume)) {
+            std::cerr << checkpoint.error() << "\n";
+            return 1;
+        }
+        if (opt.resume) {
+            checkpoint.load(state);
+            finish_resume(state);
+            std::cout << "Resumed " << opt.checkpoint << " at iteration "
+                      << state.iterations << "\n";
+        }
+    }
+    double samples_before = state.stats.total_samples(W * H);
 
-    for (int it = 1; it <= max_iterations; ++it) {
-        path_tracer_iteration(state);
+    auto t0 = std::chrono::steady_clock::now();
+    double render_seconds = 0.0;
 
-        auto current = normalize_buffer(state);
-        double residual = l2_diff(current, prev_buffer);
-        std::cout << "Iteration " << it << " residual = " << residual << "\n";
+    for (int it = state.iterations + 1; it <= max_iterations; ++it) {
+        auto t_iter = std::chrono::steady_clock::now();
+        {
+            ProfileScope scope("iteration", "render", "iteration", it);
+            path_tracer_iteration(state);
+        }
+        render_seconds += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t_iter).count();
 
-        prev_buffer = current;
-    }
+        const ConvergenceStats& st = state.stats;
+        int wt = worst_tile(state);
+        const Tile& tile = state.tiles[wt];
+        double area = double(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+        std::cout << "Iteration " << it << " residual = " << st.residual
+                  << " relMSE = " << st.rel_mse
+                  << " worst tile " << wt << " (" << tile.x0 << "," << tile.y0 << ")"
+                  << " residual = " << st.tile_residual[wt] / area
+                  << " relMSE = " << st.tile_rel_mse[wt] / area;
+        if (state.cfg.adaptive)
+            std::cout << " active tiles = " << state.active_tiles.size();
+        std::cout << "\n";
 
-    // Dump final image as PPM
-    std::ofstream out("output_cpu.ppm");
-    out << "P3\n" << W << " " << H << "\n255\n";
+        bool done = all_tiles_converged(state);
+        if (!opt.checkpoint.empty() &&
+            (it % opt.checkpoint_every == 0 || it == max_iterations || done)) {
+            ProfileScope scope("checkpoint", "io", "iteration", it);
+            auto t_save = std::chrono::steady_clock::now();
+            if (!checkpoint.save(state))
+                std::cerr << "Checkpoint to " << opt.checkpoint << " failed\n";
+            else
+                std::cout << "Checkpoint at iteration " << it << " in "
+                          << std::chrono::duration<double, std::milli>(
+                                 std::chrono::steady_clock::now() - t_save).count() << " ms\n";
+        }
 
-    auto final_img = normalize_buffer(state);
-    for (int j = H-1; j >= 0; --j) {
-        for (int i = 0; i < W; ++i) {
-            write_color(out, final_img[j*W + i]);
+        if (done) {
+            std::cout << "All tiles converged\n";
+            break;
         }
     }
 
-    std::cout << "Wrote output_cpu.ppm\n";
+    double total_seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - t0).count();
+    double samples = state.stats.total_samples(W * H);
+    double samples_run = samples - samples_before;
+    CounterBlock counters = counter_totals();
+    double rays = double(counters[Counter::camera_rays]) +
+                  double(counters[Counter::bounce_rays]) +
+                  double(counters[Counter::shadow_rays]);
+    std::cout << "Rendered " << state.iterations << " iterations on "
+              << resolve_thread_count(state.cfg.num_threads) << " threads ("
+              << (sizeof(real) == sizeof(float) ? "float32" : "float64") << ") in "
+              << total_seconds << " s (" << samples_run / render_seconds * 1e-6
+              << " Msamples/s";
+    if (COUNTERS_ENABLED) std::cout << ", " << rays / render_seconds * 1e-6 << " Mrays/s";
+    std::cout << ")\n";
+
+    if (state.cfg.adaptive) {
+        double uniform = state.stats.uniform_samples_for_same_error(W * H);
+        std::cout << "Adaptive: " << samples << " samples for relMSE " << state.stats.rel_mse
+                  << "; uniform sampling needs ~" << uniform << " ("
+                  << 100.0 * (1.0 - samples / uniform) << "% saved)\n";
+    }
+
+    std::string path = opt.output.empty() ? "output_cpu.ppm" : opt.output;
+    auto t_write = std::chrono::steady_clock::now();
+    bool written;
+    {
+        ProfileScope scope("write image", "io");
+        written = write_output(state, path);
+    }
+    if (!written) {
+        std::cerr << "Failed to write " << path << "\n";
+        return 1;
+    }
+    std::cout << "Wrote " << path << " in " << std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - t_write).count() << " ms\n";
+
+    DenoiseReport denoise;
+    if (opt.denoise) {
+        std::string denoised = denoised_path(path);
+        if (!write_denoised_output(state, denoised, opt.reference, denoise)) return 1;
+        std::cout << "Wrote " << denoised << "\n";
+        print_denoise_report(denoise);
+    }
+
+    if (COUNTERS_ENABLED) {
+        std::string json = telemetry_path(path);
+        if (write_telemetry_json(json, state, counters, render_seconds, 1,
+                                 opt.denoise ? &denoise : nullptr))
+            std::cout << "Wrote " << json << "\n";
+        else
+            std::cerr << "Failed to write " << json << "\n";
+    }
+
+    if (!opt.profile.empty()) {
+        if (write_profile_json(opt.profile, profile_events_json(0, "pathtracer_cpu")))
+            std::cout << "Wrote " << opt.profile << "\n";
+        else
+            std::cerr << "Failed to write " << opt.profile << "\n";
+    }
 
     return 0;
 }
@@ -48,6 +48,7 @@ int main(int argc, char** argv) {
         hipMemcpy(host_accum.data(), d_accum, buffer_bytes, hipMemcpyDeviceToHost);
         state.accum_buffer = host_accum;
         state.iterations = it;
+        state.stats.set_uniform_count(real(it * state.cfg.spp_per_iteration));
 
         auto current = normalize_buffer(state);
         double residual = l2_diff(current, prev_frame);
@@ -55,17 +56,10 @@ int main(int argc, char** argv) {
         prev_frame = current;
     }
 
-    auto final_img = normalize_buffer(state);
-
-    std::ofstream out("output_hip.ppm");
-    out << "P3\n" << W << " " << H << "\n255\n";
-    for (int j = H-1; j >= 0; --j) {
-        for (int i = 0; i < W; ++i) {
-            write_color(out, final_img[j*W + i],
-                        state.iterations * state.cfg.spp_per_iteration);
-        }
-    }
-    std::cout << "Wrote output_hip.ppm\n";
+    if (write_output(state, "output_hip.ppm"))
+        std::cout << "Wrote output_hip.ppm\n";
+    else
+        std::cerr << "Failed to write output_hip.ppm\n";
 
     hipFree(d_accum);
     return 0;
@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include "core/path_tracer.h"
+
+// Double-buffered ARGB8888 copy of the frame for the viewer, kept up to
+// date tile by tile.
+//
+// The render thread owns the back image. After each pass it converts the
+// tiles whose content changed since that image last saw them, then swaps it
+// with the front image under a short lock. The event thread, under the same
+// lock, hands only the tiles that changed since its last upload to the
+// texture. Changes are tracked with a version number per tile: the render
+// thread bumps a tile's version each time it traces it, and each image and
+// the texture remember the version they hold, so the back image (one swap
+// behind) also catches up on the tiles of the pass before.
+class DisplayBuffer {
+public:
+    DisplayBuffer(int width, int height, std::vector<Tile> tiles)
+        : width_(width), height_(height), tiles_(std::move(tiles)),
+          uploaded_(tiles_.size(), std::numeric_limits<uint32_t>::max()) {
+        for (Image& img : images_) {
+            img.argb.assign(size_t(width) * height, 0xff000000u);
+            img.version.assign(tiles_.size(), 0);
+        }
+    }
+
+    const std::vector<Tile>& tiles() const { return tiles_; }
+
+    // Render thread: bring the back image up to tile_version (indexed like
+    // tiles()) from state, then publish it. state may be a lower resolution
+    // preview of the frame, which is then scaled up (nearest pixel). With
+    // means (per pixel mean radiance at state's size, e.g. denoised), those
+    // are shown instead of state's accumulation. Large updates are
+    // converted on state's worker pool.
+    void publish(const PathTracerState& state, const std::vector<uint32_t>& tile_version,
+                 const std::vector<vec3>* means = nullptr) {
+        Image& back = images_[back_];
+        changed_.clear();
+        int64_t pixels = 0;
+        for (size_t t = 0; t < tiles_.size(); ++t) {
+            if (back.version[t] == tile_version[t]) continue;
+            changed_.push_back(static_cast<int>(t));
+            const Tile& tile = tiles_[t];
+            pixels += int64_t(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+        }
+
+        DisplayParams params = display_params(state.cfg);
+        TileScheduler* pool = pixels >= PARALLEL_ENCODE_MIN_PIXELS ? state.scheduler.get() : nullptr;
+        scratch_.resize(std::max<size_t>(scratch_.size(), pool ? pool->num_threads() : 1));
+        auto convert = [&](int k, int worker) {
+            convert_tile(state, means, params, tiles_[changed_[k]], back.argb, scratch_[worker]);
+        };
+        if (pool) {
+            pool->run(static_cast<int>(changed_.size()), convert);
+        } else {
+            for (size_t k = 0; k < changed_.size(); ++k) convert(static_cast<int>(k), 0);
+        }
+        for (int t : changed_) back.version[t] = tile_version[t];
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::swap(front_, back_);
+        published_.fetch_add(1, std::memory_order_release);
+    }
+
+    // Number of images published so far; the event thread only needs to
+    // upload when it changes
+    uint64_t published() const { return published_.load(std::memory_order_acquire); }
+
+    // Event thread: upload(tile, first_pixel, pitch_bytes) for every tile of
+    // the front image that differs from what was uploaded before. Returns
+    // the number of tiles uploaded.
+    template <typename Upload>
+    int upload_changed(Upload&& upload) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Image& front = images_[front_];
+        int n = 0;
+        for (size_t t = 0; t < tiles_.size(); ++t) {
+            if (uploaded_[t] == front.version[t]) continue;
+            const Tile& tile = tiles_[t];
+            upload(tile, &front.argb[size_t(tile.y0) * width_ + tile.x0],
+                   width_ * static_cast<int>(sizeof(uint32_t)));
+            uploaded_[t] = front.version[t];
+            ++n;
+        }
+        return n;
+    }
+
+private:
+    struct Image {
+        std::vector<uint32_t> argb;     // image row j = texture row j
+        std::vector<uint32_t> version;  // per tile
+    };
+
+    // The tile's pixels through the display transform. A preview source is
+    // encoded at its own resolution, one source row at a time into scratch,
+    // and repeated.
+    void convert_tile(const PathTracerState& state, const std::vector<vec3>* means,
+                      const DisplayParams& params, const Tile& tile,
+                      std::vector<uint32_t>& argb, std::vector<uint32_t>& scratch) const {
+        int sw = state.cfg.image_width;
+        int sh = state.cfg.image_height;
+        const vec3* accum = means ? means->data() : state.accum_buffer.data();
+        const real* count = means ? nullptr : state.stats.sample_count.data();
+        if (sw == width_ && sh == height_) {
+            for (int j = tile.y0; j < tile.y1; ++j) {
+                size_t first = size_t(j) * width_ + tile.x0;
+                encode_display_argb(accum[first].e, count ? count + first : nullptr,
+                                    tile.x1 - tile.x0, params, &argb[first]);
+            }
+            return;
+        }
+
+        auto source_x = [&](int i) { return static_cast<int>(int64_t(i) * sw / width_); };
+        int s0 = source_x(tile.x0);
+        int s1 = source_x(tile.x1 - 1) + 1;
+        scratch.resize(s1 - s0);
+        int encoded_row = -1;
+        for (int j = tile.y0; j < tile.y1; ++j) {
+            int sj = static_cast<int>(int64_t(j) * sh / height_);
+            if (sj != encoded_row) {
+                size_t first = size_t(sj) * sw + s0;
+                encode_display_argb(accum[first].e, count ? count + first : nullptr, s1 - s0,
+                                    params, scratch.data());
+                encoded_row = sj;
+            }
+            uint32_t* row = &argb[size_t(j) * width_];
+            for (int i = tile.x0; i < tile.x1; ++i) row[i] = scratch[source_x(i) - s0];
+        }
+    }
+
+    int width_, height_;
+    std::vector<Tile> tiles_;
+    Image images_[2];
+    int front_ = 0, back_ = 1;
+    std::vector<uint32_t> uploaded_;  // per tile: version in the texture
+    std::vector<int> changed_;        // publish(): tiles to convert
+    std::vector<std::vector<uint32_t>> scratch_;  // per worker: preview row
+    std::mutex mutex_;
+    std::atomic<uint64_t> published_{0};
+};
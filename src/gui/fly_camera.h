@@ -0,0 +1,43 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include "core/camera.h"
+
+// First-person camera pose edited by the viewer's mouse and keyboard
+// controls. yaw = pitch = 0 looks down +z with +y up, the pose of the
+// default Cornell camera.
+struct FlyCamera {
+    vec3_t<double> position{278, 278, -800};
+    double yaw = 0.0;    // radians, about +y
+    double pitch = 0.0;  // radians, kept within +-MAX_PITCH
+    double vfov = 40.0;  // degrees
+
+    static constexpr double MAX_PITCH = 1.55;
+
+    vec3_t<double> forward() const {
+        return vec3_t<double>(std::sin(yaw) * std::cos(pitch), std::sin(pitch),
+                              std::cos(yaw) * std::cos(pitch));
+    }
+
+    // Screen right, the camera's u axis
+    vec3_t<double> right() const {
+        return unit_vector(cross(forward(), vec3_t<double>(0, 1, 0)));
+    }
+
+    void turn(double d_yaw, double d_pitch) {
+        yaw += d_yaw;
+        pitch = std::clamp(pitch + d_pitch, -MAX_PITCH, MAX_PITCH);
+    }
+
+    // Move by the given distances along right, world up and forward
+    void move(double d_right, double d_up, double d_forward) {
+        position += d_right * right() + d_forward * forward();
+        position += vec3_t<double>(0, d_up, 0);
+    }
+
+    void zoom(double factor) { vfov = std::clamp(vfov * factor, 10.0, 120.0); }
+
+    camera make_camera(double aspect) const {
+        return camera(position, position + forward(), vec3_t<double>(0, 1, 0), vfov, aspect);
+    }
+};
@@ -1,7 +1,35 @@
 #include <SDL2/SDL.h>
-#include <vector>
+#include <cmath>
 #include <iostream>
 #include "core/path_tracer.h"
+#include "core/options.h"
+#include "display_buffer.h"
+#include "fly_camera.h"
+#include "progressive_renderer.h"
+
+// Event loop period when no input arrives (~60 Hz)
+static constexpr int FRAME_MS = 16;
+
+// Controls: drag with the left button to look around, WASD to move, Q/E
+// down/up (Shift: faster), wheel to zoom, R to reset the view, N to toggle
+// the denoiser, Esc to quit
+static constexpr double LOOK_RADIANS_PER_PIXEL = 0.004;
+static constexpr double MOVE_UNITS_PER_SECOND = 300.0;
+static constexpr double FAST_FACTOR = 4.0;
+static constexpr double ZOOM_PER_NOTCH = 0.9;  // vfov factor
+
+// Apply the held movement keys over dt seconds; true if the pose moved
+static bool apply_movement_keys(FlyCamera& pose, double dt) {
+    const Uint8* key = SDL_GetKeyboardState(nullptr);
+    double right = key[SDL_SCANCODE_D] - key[SDL_SCANCODE_A];
+    double up = key[SDL_SCANCODE_E] - key[SDL_SCANCODE_Q];
+    double forward = key[SDL_SCANCODE_W] - key[SDL_SCANCODE_S];
+    if (right == 0 && up == 0 && forward == 0) return false;
+    double step = MOVE_UNITS_PER_SECOND * dt;
+    if (key[SDL_SCANCODE_LSHIFT] || key[SDL_SCANCODE_RSHIFT]) step *= FAST_FACTOR;
+    pose.move(right * step, up * step, forward * step);
+    return true;
+}
 
 int main(int argc, char** argv) {
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
@@ -10,6 +38,15 @@ int main(int argc, char** argv) {
     }
 
     PathTracerState state = make_default_state();
+    RunOptions opt;
+    opt.max_iterations = 0;
+    if (!parse_options(argc, argv, opt, state.cfg)) return 1;
+    load_scene(state);
+    if (!opt.profile.empty()) {
+        profiler_start();
+        set_profile_thread_name("main");
+    }
+
     int W = state.cfg.image_width;
     int H = state.cfg.image_height;
 
@@ -31,44 +68,91 @@ int main(int argc, char** argv) {
         W, H
     );
 
-    bool running = true;
-    SDL_Event e;
+    // Tracing runs on its own thread (see ProgressiveRenderer); this one
+    // only handles input and uploads what changed, so it stays at display
+    // rate however long a pass takes. Iterations (0 = unlimited) stop the
+    // tracing of each view, not the viewer.
+    DisplayBuffer display(W, H, make_tiles(W, H, state.cfg.tile_size));
+    ProgressiveRenderer render(state, display, opt.max_iterations);
+    render.set_denoise(opt.denoise);
+    auto update_title = [&] {
+        SDL_SetWindowTitle(window, render.denoise() ? "APMA2822B Path Tracer (denoised)"
+                                                    : "APMA2822B Path Tracer");
+    };
+    update_title();
+    double aspect = static_cast<double>(W) / H;
+    FlyCamera pose;
 
+    auto upload = [texture](const Tile& tile, const uint32_t* pixels, int pitch) {
+        SDL_Rect rect{tile.x0, tile.y0, tile.x1 - tile.x0, tile.y1 - tile.y0};
+        SDL_UpdateTexture(texture, &rect, pixels, pitch);
+    };
+    display.upload_changed(upload);  // the black initial image
+    uint64_t shown = 0;
+
+    bool running = true;
+    int frame = 0;
+    Uint32 last_ticks = SDL_GetTicks();
     while (running) {
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_QUIT) running = false;
+        ProfileScope frame_scope("frame", "gui", "frame", frame++);
+        bool moved = false;
+        SDL_Event e;
+        if (SDL_WaitEventTimeout(&e, FRAME_MS)) {
+            do {
+                switch (e.type) {
+                    case SDL_QUIT:
+                        running = false;
+                        break;
+                    case SDL_MOUSEMOTION:
+                        if (e.motion.state & SDL_BUTTON_LMASK) {
+                            pose.turn(-e.motion.xrel * LOOK_RADIANS_PER_PIXEL,
+                                      -e.motion.yrel * LOOK_RADIANS_PER_PIXEL);
+                            moved = true;
+                        }
+                        break;
+                    case SDL_MOUSEWHEEL:
+                        pose.zoom(std::pow(ZOOM_PER_NOTCH, e.wheel.y));
+                        moved = true;
+                        break;
+                    case SDL_KEYDOWN:
+                        if (e.key.keysym.sym == SDLK_ESCAPE) running = false;
+                        if (e.key.keysym.sym == SDLK_r) {
+                            pose = FlyCamera();
+                            moved = true;
+                        }
+                        if (e.key.keysym.sym == SDLK_n) {
+                            render.set_denoise(!render.denoise());
+                            update_title();
+                        }
+                        break;
+                }
+            } while (SDL_PollEvent(&e));
         }
 
-        path_tracer_iteration(state);
-        auto img = normalize_buffer(state);
-
-        // Convert to ARGB
-        std::vector<uint32_t> pixels(W * H);
-        double scale = 1.0;
-        for (int j = 0; j < H; ++j) {
-            for (int i = 0; i < W; ++i) {
-                vec3 c = img[j*W + i];
-                double r = std::sqrt(c.x());
-                double g = std::sqrt(c.y());
-                double b = std::sqrt(c.z());
-                uint8_t R = static_cast<uint8_t>(255 * std::clamp(r, 0.0, 0.999));
-                uint8_t G = static_cast<uint8_t>(255 * std::clamp(g, 0.0, 0.999));
-                uint8_t B = static_cast<uint8_t>(255 * std::clamp(b, 0.0, 0.999));
-                pixels[j*W + i] = (255u << 24) | (R << 16) | (G << 8) | B;
-            }
-        }
+        Uint32 ticks = SDL_GetTicks();
+        moved |= apply_movement_keys(pose, (ticks - last_ticks) * 1e-3);
+        last_ticks = ticks;
+        if (moved) render.set_camera(pose.make_camera(aspect));
 
-        void* tex_pixels;
-        int pitch;
-        SDL_LockTexture(texture, nullptr, &tex_pixels, &pitch);
-        std::memcpy(tex_pixels, pixels.data(), W * H * sizeof(uint32_t));
-        SDL_UnlockTexture(texture);
+        uint64_t published = display.published();
+        if (published != shown) {
+            ProfileScope scope("upload", "gui");
+            display.upload_changed(upload);
+            shown = published;
+        }
 
+        ProfileScope scope("present", "gui");
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture, nullptr, nullptr);
         SDL_RenderPresent(renderer);
     }
 
+    render.stop();
+
+    if (!opt.profile.empty() &&
+        !write_profile_json(opt.profile, profile_events_json(0, "pathtracer_gui")))
+        std::cerr << "Failed to write " << opt.profile << "\n";
+
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
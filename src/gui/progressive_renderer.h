@@ -0,0 +1,167 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "core/path_tracer.h"
+#include "core/denoise.h"
+#include "display_buffer.h"
+
+// Render thread of the viewer. Renders state progressively into a
+// DisplayBuffer and restarts whenever the camera changes.
+//
+// After a restart the first images come from low resolution previews at
+// 1 spp: one pass at 1/8, 1/4 and 1/2 of the frame size in turn, each
+// scaled up for display, before full resolution passes accumulate as
+// usual. A pass in flight when the camera moves stops handing out tiles,
+// so the first preview of the new view waits for at most one tile of the
+// old pass.
+//
+// With the denoiser on, every full resolution pass is shown denoised
+// (previews never are); toggling it re-shows the current image.
+class ProgressiveRenderer {
+public:
+    static constexpr int PREVIEW_LEVELS = 3;  // 1/2, 1/4, 1/8 resolution
+
+    // max_iterations: full resolution passes per view (0 = unlimited)
+    ProgressiveRenderer(PathTracerState& state, DisplayBuffer& display, int max_iterations)
+        : state_(state), display_(display), max_iterations_(max_iterations),
+          pending_cam_(state.cam) {
+        prepare_scheduler(state_);
+        for (int level = 1; level <= PREVIEW_LEVELS; ++level) {
+            PathTracerConfig cfg = state_.cfg;
+            cfg.image_width = std::max(1, cfg.image_width >> level);
+            cfg.image_height = std::max(1, cfg.image_height >> level);
+            cfg.tile_size = std::max(8, cfg.tile_size >> level);
+            cfg.spp_per_iteration = 1;
+            cfg.adaptive = false;
+            previews_.emplace_back(state_.scene, state_.cam, cfg);
+            previews_.back().scheduler = state_.scheduler;  // one worker pool
+        }
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~ProgressiveRenderer() { stop(); }
+
+    ProgressiveRenderer(const ProgressiveRenderer&) = delete;
+    ProgressiveRenderer& operator=(const ProgressiveRenderer&) = delete;
+
+    // Event thread: render from this camera, starting over
+    void set_camera(const camera& cam) {
+        {
+            std::lock_guard<std::mutex> lock(cam_mutex_);
+            pending_cam_ = cam;
+        }
+        view_version_.fetch_add(1, std::memory_order_release);
+    }
+
+    // Event thread: show full resolution passes denoised or not
+    void set_denoise(bool on) { denoise_.store(on, std::memory_order_relaxed); }
+    bool denoise() const { return denoise_.load(std::memory_order_relaxed); }
+
+    // Abandon the pass in flight and join the render thread
+    void stop() {
+        quit_.store(true, std::memory_order_relaxed);
+        if (thread_.joinable()) thread_.join();
+    }
+
+private:
+    void run() {
+        set_profile_thread_name("render");
+        std::vector<uint32_t> tile_version(display_.tiles().size(), 0);
+        uint64_t seen = 0;
+        int level = PREVIEW_LEVELS;
+
+        while (!quit_.load(std::memory_order_relaxed)) {
+            uint64_t view = view_version_.load(std::memory_order_acquire);
+            if (view != seen) {
+                camera cam = [this] {
+                    std::lock_guard<std::mutex> lock(cam_mutex_);
+                    return pending_cam_;
+                }();
+                for (PathTracerState* s : all_states()) {
+                    s->cam = cam;
+                    reset_accumulation(*s);
+                }
+                seen = view;
+                level = PREVIEW_LEVELS;
+            }
+
+            bool want_denoised = denoise_.load(std::memory_order_relaxed);
+            if (level == 0 && state_.iterations > 0 && want_denoised != shown_denoised_) {
+                for (uint32_t& v : tile_version) ++v;
+                publish_full(tile_version, want_denoised);
+                continue;
+            }
+
+            PathTracerState& s = level > 0 ? previews_[level - 1] : state_;
+            bool finished = level == 0 &&
+                ((max_iterations_ > 0 && s.iterations >= max_iterations_) ||
+                 all_tiles_converged(s));
+            if (finished) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                continue;
+            }
+
+            bool complete;
+            {
+                ProfileScope scope(level > 0 ? "preview" : "iteration", "render",
+                                   "level", level);
+                complete = path_tracer_iteration(s, [this, view] {
+                    return quit_.load(std::memory_order_relaxed) ||
+                           view_version_.load(std::memory_order_relaxed) != view;
+                });
+            }
+            if (!complete) continue;
+
+            // A preview or denoised image covers the whole frame; a full
+            // resolution pass the tiles it traced
+            if (level > 0) {
+                for (uint32_t& v : tile_version) ++v;
+                ProfileScope scope("convert", "gui");
+                display_.publish(s, tile_version);
+                shown_denoised_ = false;
+                --level;
+            } else if (want_denoised) {
+                for (uint32_t& v : tile_version) ++v;
+                publish_full(tile_version, true);
+            } else {
+                for (int t : s.active_tiles) ++tile_version[t];
+                publish_full(tile_version, false);
+            }
+        }
+    }
+
+    // Publish the full resolution image, denoised or not
+    void publish_full(const std::vector<uint32_t>& tile_version, bool denoised) {
+        if (denoised) {
+            ProfileScope scope("denoise", "render");
+            denoiser_.run(state_, denoised_, state_.scheduler.get());
+        }
+        ProfileScope scope("convert", "gui");
+        display_.publish(state_, tile_version, denoised ? &denoised_ : nullptr);
+        shown_denoised_ = denoised;
+    }
+
+    std::vector<PathTracerState*> all_states() {
+        std::vector<PathTracerState*> states{&state_};
+        for (PathTracerState& p : previews_) states.push_back(&p);
+        return states;
+    }
+
+    PathTracerState& state_;
+    DisplayBuffer& display_;
+    int max_iterations_;
+    std::vector<PathTracerState> previews_;  // [level - 1]
+    Denoiser denoiser_;
+    std::vector<vec3> denoised_;
+    bool shown_denoised_ = false;  // render thread: what the display holds
+
+    std::mutex cam_mutex_;
+    camera pending_cam_;
+    std::atomic<uint64_t> view_version_{0};
+    std::atomic<bool> quit_{false};
+    std::atomic<bool> denoise_{false};
+    std::thread thread_;
+};
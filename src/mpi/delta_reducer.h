@@ -0,0 +1,196 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <vector>
+#include "core/path_tracer.h"
+
+// Sums the per-pixel samples every rank traced during a sync window and
+// merges the result into each rank's replica of the accumulation state.
+//
+// Per pixel a window holds the radiance sum, the sample count, and the
+// luminance power sums about the replica's mean at the start of the window
+// (so the variance does not cancel in float). All of it is additive, so
+// summing the windows of several ranks combines their samples, whether
+// they traced disjoint tiles or the same pixels.
+//
+// Ranks on one node never send windows to each other. Each rank fills its
+// own segment of a node-wide MPI_Win_allocate_shared window; at a sync the
+// node leader sums the segments in place and is the only rank that enters
+// the inter-node MPI_Iallreduce; the node's ranks then read the reduced
+// window straight out of the leader's memory. Windows are double-buffered:
+// the reduction of one runs while the next is traced, and it is merged at
+// the following sync.
+class DeltaReducer {
+public:
+    static constexpr int FIELDS = 6;
+
+    DeltaReducer(MPI_Comm comm, int pixels) : pixels_(pixels), n_(size_t(pixels) * FIELDS) {
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm_);
+        MPI_Comm_rank(node_comm_, &node_rank_);
+        MPI_Comm_size(node_comm_, &node_size_);
+        MPI_Comm_split(comm, node_rank_ == 0 ? 0 : MPI_UNDEFINED, 0, &leader_comm_);
+
+        // Every rank: two window segments. Leader: two reduced windows too.
+        MPI_Aint bytes = MPI_Aint((node_rank_ == 0 ? 4 : 2) * n_ * sizeof(float));
+        float* base = nullptr;
+        MPI_Win_allocate_shared(bytes, sizeof(float), MPI_INFO_NULL, node_comm_, &base, &win_);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+
+        for (int b = 0; b < 2; ++b) segments_[b].resize(node_size_);
+        for (int r = 0; r < node_size_; ++r) {
+            MPI_Aint size;
+            int disp;
+            float* p;
+            MPI_Win_shared_query(win_, r, &size, &disp, &p);
+            segments_[0][r] = p;
+            segments_[1][r] = p + n_;
+            if (r == 0) {
+                reduced_[0] = p + 2 * n_;
+                reduced_[1] = p + 3 * n_;
+            }
+        }
+    }
+
+    ~DeltaReducer() {
+        MPI_Win_unlock_all(win_);
+        MPI_Win_free(&win_);
+        if (leader_comm_ != MPI_COMM_NULL) MPI_Comm_free(&leader_comm_);
+        MPI_Comm_free(&node_comm_);
+    }
+
+    DeltaReducer(const DeltaReducer&) = delete;
+    DeltaReducer& operator=(const DeltaReducer&) = delete;
+
+    bool is_node_leader() const { return node_rank_ == 0; }
+    int node_size() const { return node_size_; }
+
+    // Start a window: clear this rank's segment and snapshot the means
+    void begin(const ConvergenceStats& stats) {
+        std::fill(segments_[cur_][node_rank_], segments_[cur_][node_rank_] + n_, 0.0f);
+        shift_[cur_].assign(stats.lum_mean.begin(), stats.lum_mean.begin() + pixels_);
+    }
+
+    // Record one pixel's samples; threads must add disjoint pixels
+    void add(int idx, const SampleBatch& b) {
+        if (b.n == 0) return;
+        float* p = segments_[cur_][node_rank_] + size_t(idx) * FIELDS;
+        double d = double(b.mean) - shift_[cur_][idx];
+        p[0] += float(b.sum.x());
+        p[1] += float(b.sum.y());
+        p[2] += float(b.sum.z());
+        p[3] += float(b.n);
+        p[4] += float(b.n * d);
+        p[5] += float(b.m2 + b.n * d * d);
+    }
+
+    // Let a reduction in flight progress
+    void poll() {
+        int prev = cur_ ^ 1;
+        if (pending_[prev] && request_[prev] != MPI_REQUEST_NULL) {
+            int done;
+            MPI_Test(&request_[prev], &done, MPI_STATUS_IGNORE);
+        }
+    }
+
+    // Close the current window: merge the previous one into state if it is
+    // still outstanding, start reducing this one and begin the next.
+    // Collective over the communicator. Returns true if a window was merged.
+    bool sync(PathTracerState& state) {
+        int prev = cur_ ^ 1;
+        bool merged = pending_[prev];
+        if (merged) wait(prev);
+        else node_barrier();  // segments of cur_ complete
+        if (merged) merge(state, prev);
+
+        if (is_node_leader()) {
+            ProfileScope scope("node reduce", "mpi");
+            float* dst = reduced_[cur_];
+            std::copy(segments_[cur_][0], segments_[cur_][0] + n_, dst);
+            for (int r = 1; r < node_size_; ++r) {
+                const float* src = segments_[cur_][r];
+                for (size_t i = 0; i < n_; ++i) dst[i] += src[i];
+            }
+            MPI_Iallreduce(MPI_IN_PLACE, dst, static_cast<int>(n_), MPI_FLOAT, MPI_SUM,
+                           leader_comm_, &request_[cur_]);
+        }
+        pending_[cur_] = true;
+
+        cur_ = prev;
+        begin(state.stats);
+        return merged;
+    }
+
+    // Merge the window still in flight, if any. Collective.
+    void drain(PathTracerState& state) {
+        int prev = cur_ ^ 1;
+        if (!pending_[prev]) return;
+        wait(prev);
+        merge(state, prev);
+    }
+
+private:
+    void node_barrier() {
+        ProfileScope scope("node barrier", "mpi");
+        MPI_Win_sync(win_);
+        MPI_Barrier(node_comm_);
+        MPI_Win_sync(win_);
+    }
+
+    // Leader completes the reduction of window b; the barrier then publishes
+    // it (and everyone's current segments) to the node
+    void wait(int b) {
+        if (is_node_leader()) {
+            ProfileScope scope("wait allreduce", "mpi");
+            MPI_Wait(&request_[b], MPI_STATUS_IGNORE);
+        }
+        node_barrier();
+    }
+
+    // Merge reduced window b into the replica and recompute the per-tile
+    // sums of the tiles it touched
+    void merge(PathTracerState& state, int b) {
+        ProfileScope scope("merge window", "mpi");
+        pending_[b] = false;
+        const float* data = reduced_[b];
+        const std::vector<real>& shift = shift_[b];
+
+        int W = state.cfg.image_width;
+        ConvergenceStats& stats = state.stats;
+        std::fill(stats.tile_residual.begin(), stats.tile_residual.end(), 0.0);
+        for (size_t t = 0; t < state.tiles.size(); ++t) {
+            const Tile& tile = state.tiles[t];
+            double residual = 0.0;
+            bool touched = false;
+            for (int j = tile.y0; j < tile.y1; ++j) {
+                for (int i = tile.x0; i < tile.x1; ++i) {
+                    int idx = j*W + i;
+                    const float* p = data + size_t(idx) * FIELDS;
+                    if (p[3] == 0.0f) continue;
+                    SampleBatch s;
+                    s.sum = vec3(real(p[0]), real(p[1]), real(p[2]));
+                    s.n = real(p[3]);
+                    double s1 = p[4], s2 = p[5];
+                    s.mean = real(shift[idx] + s1 / s.n);
+                    s.m2 = real(std::max(0.0, s2 - s1 * s1 / s.n));
+                    residual += stats.merge(state.accum_buffer, idx, s);
+                    touched = true;
+                }
+            }
+            stats.tile_residual[t] = residual;
+            if (touched) stats.tile_rel_mse[t] = stats.tile_rel_mse_sum(W, tile);
+        }
+        stats.reduce(W * state.cfg.image_height);
+    }
+
+    int pixels_;
+    size_t n_;  // floats per window
+    MPI_Comm node_comm_ = MPI_COMM_NULL, leader_comm_ = MPI_COMM_NULL;
+    int node_rank_ = 0, node_size_ = 1;
+    MPI_Win win_;
+    std::vector<float*> segments_[2];  // [window buffer][node rank]
+    float* reduced_[2] = {nullptr, nullptr};
+    std::vector<real> shift_[2];
+    MPI_Request request_[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    bool pending_[2] = {false, false};
+    int cur_ = 0;  // window buffer being filled
+};
@@ -1,122 +1,388 @@
 #include <mpi.h>
+#include <algorithm>
 #include <vector>
 #include <iostream>
-#include <fstream>
+#include <string>
+#include <memory>
 #include "core/path_tracer.h"
 #include "core/metrics.h"
+#include "core/options.h"
+#include "core/checkpoint.h"
+#include "core/telemetry.h"
+#include "core/denoise.h"
+#include "delta_reducer.h"
+
+// Distributed progressive rendering. Every rank keeps a full replica of the
+// accumulation state (accum_buffer and ConvergenceStats). Each pass, ranks
+// claim tiles from the active list and trace them with the local
+// TileScheduler, without merging: every pixel's sample batch is folded into
+// a float delta window instead (see DeltaReducer).
+//
+// Every --mpi-sync N passes the windows of all ranks are summed, through
+// shared memory within a node and a non-blocking MPI_Iallreduce between
+// node leaders, while the next window is traced. The sum is merged into
+// every replica at the following sync point, so the replicas stay
+// identical (same adaptive budgets, same retired tiles) and trail the
+// traced samples by one window. Because counts lag, samples are numbered
+// by pass (ConvergenceStats::pass_sample_base).
+//
+// Decomposition (--mpi-decomp):
+//   image (default)   -- ranks split the active tiles of each pass
+//                        (--mpi-schedule):
+//     dynamic (default) -- a counter per pass on rank 0 hands out batches
+//                          of tiles (MPI_Fetch_and_op, passive target), so
+//                          a rank that finishes early simply claims more
+//     static            -- rank r traces a fixed contiguous share of the
+//                          active tiles (the old row-band split)
+//   samples           -- every rank traces every active tile with its own
+//                        disjoint range of sample indices. No tile
+//                        bookkeeping and nothing to balance beyond the
+//                        local thread pool, so one rank per node or NUMA
+//                        domain works well. The window sums are additive,
+//                        so the same reduction combines the ranks' samples
+//                        of a pixel.
+
+// Sum every rank's first-hit AOVs into rank 0's. Ranks keep only the AOVs
+// of the samples they traced themselves (they never enter the delta
+// windows), and those sums are additive like the radiance.
+static void reduce_aov(AovBuffers& aov, int world_rank) {
+    MPI_Datatype type = sizeof(real) == sizeof(float) ? MPI_FLOAT : MPI_DOUBLE;
+    auto sum = [&](void* data, size_t count) {
+        void* send = world_rank == 0 ? MPI_IN_PLACE : data;
+        MPI_Reduce(send, data, static_cast<int>(count), type, MPI_SUM, 0, MPI_COMM_WORLD);
+    };
+    sum(aov.albedo.data(), 3 * aov.albedo.size());
+    sum(aov.normal.data(), 3 * aov.normal.size());
+    sum(aov.emission.data(), 3 * aov.emission.size());
+    sum(aov.depth.data(), aov.depth.size());
+    sum(aov.count.data(), aov.count.size());
+}
+
+// After a resume each rank holds only its own shard's rows; rebuild the
+// full replica from everyone's rows
+static void allgather_rows(PathTracerState& state, int world_size) {
+    int W = state.cfg.image_width;
+    int H = state.cfg.image_height;
+    std::vector<int> counts(world_size), displs(world_size);
+    auto gather = [&](void* base, int elem_bytes) {
+        for (int r = 0; r < world_size; ++r) {
+            int row_begin = static_cast<int>(long(H) * r / world_size);
+            int row_end = static_cast<int>(long(H) * (r + 1) / world_size);
+            displs[r] = row_begin * W * elem_bytes;
+            counts[r] = (row_end - row_begin) * W * elem_bytes;
+        }
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, base, counts.data(), displs.data(),
+                       MPI_BYTE, MPI_COMM_WORLD);
+    };
+    gather(state.accum_buffer.data(), sizeof(vec3));
+    gather(state.stats.sample_count.data(), sizeof(real));
+    gather(state.stats.lum_mean.data(), sizeof(real));
+    gather(state.stats.lum_m2.data(), sizeof(real));
+}
 
 int main(int argc, char** argv) {
-    MPI_Init(&argc, &argv);
+    // Every rank runs a worker pool, but only the main thread (worker 0)
+    // calls MPI
+    int provided = MPI_THREAD_SINGLE;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 
     int world_rank, world_size;
     MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &world_size);
-
-    int max_iterations = 128;
-    if (argc > 1) {
-        max_iterations = std::atoi(argv[1]);
+    if (provided < MPI_THREAD_FUNNELED) {
+        if (world_rank == 0)
+            std::cerr << "MPI library lacks MPI_THREAD_FUNNELED support, which the "
+                         "threaded renderer needs\n";
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
     PathTracerState state = make_default_state();
+    RunOptions opt;
+    opt.max_iterations = 128;
+    if (!parse_options(argc, argv, opt, state.cfg)) {
+        MPI_Finalize();
+        return 1;
+    }
+    load_scene(state);
+    if (!opt.profile.empty()) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        profiler_start();
+        set_profile_thread_name("main");
+    }
+    int max_iterations = opt.max_iterations;
+    int sync_interval = opt.mpi_sync_interval;
+
     int W = state.cfg.image_width;
     int H = state.cfg.image_height;
+    int pixels = W * H;
+
+    // Checkpoints are sharded by rows, one file per rank: FILE.rank<r>of<n>
+    Checkpoint checkpoint;
+    if (!opt.checkpoint.empty()) {
+        int row_begin = static_cast<int>(long(H) * world_rank / world_size);
+        int row_end = static_cast<int>(long(H) * (world_rank + 1) / world_size);
+        std::string shard = opt.checkpoint + ".rank" + std::to_string(world_rank) +
+                            "of" + std::to_string(world_size);
+        int ok = checkpoint.open(shard, state, row_begin, row_end, opt.resume) ? 1 : 0;
+        if (!ok) std::cerr << checkpoint.error() << "\n";
+        int all_ok = 0;
+        MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (!all_ok) {
+            MPI_Finalize();
+            return 1;
+        }
+        if (opt.resume) {
+            checkpoint.load(state);
+            allgather_rows(state, world_size);
+            finish_resume(state);
+            if (world_rank == 0)
+                std::cout << "Resumed " << world_size << " shards of " << opt.checkpoint
+                          << " at iteration " << state.iterations << "\n";
+        }
+    }
+
+    // Budgets and tile retirement read the replica, which trails the traced
+    // passes by up to two sync windows
+    state.cfg.adaptive_warmup += 2 * sync_interval;
+
+    // One tile counter per pass, so they never need resetting and a fast
+    // rank may run ahead into the next pass
+    long* counters = nullptr;
+    MPI_Win counter_win;
+    MPI_Aint counter_bytes = world_rank == 0 ? MPI_Aint(max_iterations) * sizeof(long) : 0;
+    MPI_Win_allocate(counter_bytes, sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD,
+                     &counters, &counter_win);
+    if (world_rank == 0) std::fill(counters, counters + max_iterations, 0L);
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Win_lock_all(0, counter_win);
+
+    // Adaptive passes draw up to max_spp samples per pixel
+    int64_t samples_per_pass = state.cfg.adaptive
+        ? std::max(state.cfg.spp_per_iteration, state.cfg.adaptive_max_spp)
+        : state.cfg.spp_per_iteration;
+
+    // Holds MPI windows and communicators, so it must go before MPI_Finalize
+    auto reducer = std::make_unique<DeltaReducer>(MPI_COMM_WORLD, pixels);
+    reducer->begin(state.stats);
+    int window_passes = 0;  // passes traced into the current window
 
-    // Simple 1D decomposition over rows
-    int rows_per_rank = H / world_size;
-    int y_start = world_rank * rows_per_rank;
-    int y_end = (world_rank == world_size - 1) ? H : y_start + rows_per_rank;
-
-    std::vector<vec3> local_accum((y_end - y_start) * W, vec3(0,0,0));
-    state.accum_buffer.assign(W*H, vec3(0,0,0));
-
-    for (int it = 1; it <= max_iterations; ++it) {
-        // Local iteration
-        for (int j = y_start; j < y_end; ++j) {
-            for (int i = 0; i < W; ++i) {
-                vec3 pixel_color(0,0,0);
-                for (int s = 0; s < state.cfg.spp_per_iteration; ++s) {
-                    double u = (i + random_double()) / (W - 1);
-                    double v = (j + random_double()) / (H - 1);
-                    ray r = state.cam.get_ray(u, 1.0 - v);
-                    pixel_color += ray_color(r, state.scene, state.cfg.max_depth);
+    // Per-rank timing: busy = tracing; everything else (claiming tiles,
+    // waiting for reductions, merging) is idle time
+    double busy_seconds = 0.0;
+    long tiles_rendered = 0;
+    double t_start = MPI_Wtime();
+
+    for (int it = state.iterations + 1; it <= max_iterations; ++it) {
+        ProfileScope iteration_scope("iteration", "render", "iteration", it);
+        begin_pass(state);
+        if (opt.mpi_samples)
+            state.stats.pass_sample_base =
+                (int64_t(state.iterations) * world_size + world_rank) * samples_per_pass;
+        else
+            state.stats.pass_sample_base = state.iterations * samples_per_pass;
+        int n_active = static_cast<int>(state.active_tiles.size());
+
+        // Worker 0 is this thread, the only one that calls MPI; it lets the
+        // reduction in flight progress between its tiles, whatever the
+        // decomposition
+        auto trace_range = [&](int k0, int n) {
+            double t0 = MPI_Wtime();
+            state.scheduler->run(n, [&state, &reducer, k0](int k, int worker) {
+                trace_active_tile(state, k0 + k, worker,
+                                  [&state, &reducer](int idx, const SampleBatch& batch) {
+                                      reducer->add(idx, batch);
+                                      state.aov.add(idx, batch.first_hits, batch.n);
+                                  });
+                if (worker == 0) reducer->poll();
+            });
+            busy_seconds += MPI_Wtime() - t0;
+            tiles_rendered += n;
+        };
+
+        if (opt.mpi_samples) {
+            trace_range(0, n_active);
+        } else if (opt.mpi_static) {
+            int k0 = static_cast<int>(long(n_active) * world_rank / world_size);
+            int k1 = static_cast<int>(long(n_active) * (world_rank + 1) / world_size);
+            trace_range(k0, k1 - k0);
+        } else {
+            // One tile per local worker per claim keeps the pool busy while
+            // leaving as much of the queue as possible to other ranks
+            long batch = state.scheduler->num_threads();
+            for (;;) {
+                long k0;
+                {
+                    ProfileScope scope("claim tiles", "mpi");
+                    MPI_Fetch_and_op(&batch, &k0, MPI_LONG, 0, it - 1, MPI_SUM, counter_win);
+                    MPI_Win_flush(0, counter_win);
                 }
-                local_accum[(j - y_start)*W + i] += pixel_color;
+                if (k0 >= n_active) break;
+                trace_range(static_cast<int>(k0),
+                            static_cast<int>(std::min<long>(batch, n_active - k0)));
             }
         }
 
-        // Gather full image across ranks
-        std::vector<vec3> global_accum;
-        if (world_rank == 0) {
-            global_accum.resize(W * H);
+        window_passes += 1;
+
+        if (window_passes == sync_interval) {
+            bool merged;
+            {
+                ProfileScope scope("sync", "mpi", "iteration", it);
+                merged = reducer->sync(state);
+            }
+            window_passes = 0;
+
+            if (merged && world_rank == 0) {
+                std::cout << "Iteration " << it << " merged through pass " << it - sync_interval
+                          << " residual = " << state.stats.residual
+                          << " relMSE = " << state.stats.rel_mse;
+                if (state.cfg.adaptive)
+                    std::cout << " active tiles = " << state.active_tiles.size();
+                std::cout << "\n";
+            }
         }
+        end_pass(state);
 
-        int local_count = (y_end - y_start) * W * 3;
-        std::vector<double> local_flat(local_count);
-        for (int idx = 0; idx < (int)local_accum.size(); ++idx) {
-            local_flat[3*idx+0] = local_accum[idx].x();
-            local_flat[3*idx+1] = local_accum[idx].y();
-            local_flat[3*idx+2] = local_accum[idx].z();
+        // A checkpoint must not miss samples still in a window, so merge
+        // everything first; this pass loses its overlap
+        bool done = all_tiles_converged(state);
+        if (!opt.checkpoint.empty() &&
+            (it % opt.checkpoint_every == 0 || it == max_iterations || done)) {
+            ProfileScope scope("checkpoint", "io", "iteration", it);
+            if (window_passes > 0) reducer->sync(state);
+            reducer->drain(state);
+            window_passes = 0;
+            double t_save = MPI_Wtime();
+            if (!checkpoint.save(state))
+                std::cerr << "Rank " << world_rank << ": checkpoint failed\n";
+            ProfileScope barrier_scope("barrier", "mpi");
+            MPI_Barrier(MPI_COMM_WORLD);
+            if (world_rank == 0)
+                std::cout << "Checkpoint at iteration " << it << " in "
+                          << (MPI_Wtime() - t_save) * 1e3 << " ms\n";
         }
 
-        std::vector<int> recvcounts(world_size);
-        std::vector<int> displs(world_size);
-        if (world_rank == 0) {
-            int disp = 0;
-            for (int r = 0; r < world_size; ++r) {
-                int ys = r * rows_per_rank;
-                int ye = (r == world_size - 1) ? H : ys + rows_per_rank;
-                int cnt = (ye - ys) * W * 3;
-                recvcounts[r] = cnt;
-                displs[r] = disp;
-                disp += cnt;
-            }
+        if (done) {
+            if (world_rank == 0) std::cout << "All tiles converged\n";
+            break;
         }
+    }
 
-        std::vector<double> global_flat;
-        if (world_rank == 0) {
-            global_flat.resize(W * H * 3);
+    // Drain: the window in flight, then whatever was traced since
+    {
+        ProfileScope scope("drain", "mpi");
+        if (window_passes > 0) reducer->sync(state);
+        reducer->drain(state);
+    }
+    double total_seconds = MPI_Wtime() - t_start;
+
+    int is_leader = reducer->is_node_leader() ? 1 : 0, nodes = 0;
+    MPI_Allreduce(&is_leader, &nodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    reducer.reset();
+    MPI_Win_unlock_all(counter_win);
+    MPI_Win_free(&counter_win);
+
+    // Load balance report: imbalance = max / mean busy time (1 = perfect)
+    double mine_times[3] = {busy_seconds, total_seconds - busy_seconds, double(tiles_rendered)};
+    std::vector<double> all_times(world_rank == 0 ? 3 * world_size : 0);
+    CounterBlock mine = counter_totals(), run_counters;
+    {
+        ProfileScope scope("gather report", "mpi");
+        MPI_Gather(mine_times, 3, MPI_DOUBLE, all_times.data(), 3, MPI_DOUBLE, 0,
+                   MPI_COMM_WORLD);
+        // Hot-path counters summed over ranks
+        MPI_Reduce(mine.v, run_counters.v, NUM_COUNTERS, MPI_UINT64_T, MPI_SUM, 0,
+                   MPI_COMM_WORLD);
+        MPI_Reduce(mine.ticks, run_counters.ticks, NUM_STAGES, MPI_UINT64_T, MPI_SUM, 0,
+                   MPI_COMM_WORLD);
+        if (opt.denoise) reduce_aov(state.aov, world_rank);
+    }
+
+    if (world_rank == 0) {
+        std::cout << "Final residual = " << state.stats.residual
+                  << " relMSE = " << state.stats.rel_mse << "\n";
+
+        double busy_max = 0.0, busy_sum = 0.0, idle_sum = 0.0;
+        const char* decomp = opt.mpi_samples ? "sample split"
+                           : opt.mpi_static ? "static tiles" : "dynamic tiles";
+        std::cout << "Load balance (" << decomp << ", sync every " << sync_interval
+                  << " passes, " << world_size << " ranks on " << nodes << " nodes x "
+                  << state.scheduler->num_threads() << " threads):\n";
+        for (int r = 0; r < world_size; ++r) {
+            double busy = all_times[3*r + 0];
+            double idle = all_times[3*r + 1];
+            busy_max = std::max(busy_max, busy);
+            busy_sum += busy;
+            idle_sum += idle;
+            std::cout << "  rank " << r << ": " << static_cast<long>(all_times[3*r + 2])
+                      << " tiles, busy " << busy << " s, idle " << idle << " s ("
+                      << 100.0 * idle / (busy + idle) << "%)\n";
         }
+        double busy_mean = busy_sum / world_size;
+        std::cout << "  imbalance (max/mean busy) = " << busy_max / busy_mean
+                  << ", mean idle = " << idle_sum / world_size << " s\n";
 
-        MPI_Gatherv(local_flat.data(), local_count, MPI_DOUBLE,
-                    world_rank == 0 ? global_flat.data() : nullptr,
-                    recvcounts.data(), displs.data(), MPI_DOUBLE,
-                    MPI_COMM_WORLD);
+        double samples = state.stats.total_samples(pixels);
+        std::cout << "Rendered " << state.iterations << " iterations in " << total_seconds
+                  << " s (" << samples / total_seconds * 1e-6 << " Msamples/s)\n";
 
-        if (world_rank == 0) {
-            // Unpack
-            for (int j = 0; j < H; ++j) {
-                for (int i = 0; i < W; ++i) {
-                    int idx = j*W + i;
-                    state.accum_buffer[idx] = vec3(
-                        global_flat[3*idx+0],
-                        global_flat[3*idx+1],
-                        global_flat[3*idx+2]
-                    );
-                }
-            }
+        std::string path = opt.output.empty() ? "output_mpi_cpu.ppm" : opt.output;
+        double t_write = MPI_Wtime();
+        bool written;
+        {
+            ProfileScope scope("write image", "io");
+            written = write_output(state, path);
+        }
+        if (written)
+            std::cout << "Wrote " << path << " in " << (MPI_Wtime() - t_write) * 1e3 << " ms\n";
+        else
+            std::cerr << "Failed to write " << path << "\n";
 
-            auto current = normalize_buffer(state);
-            static std::vector<vec3> prev = current;
-            double residual = l2_diff(current, prev);
-            // Global residual is computed on rank 0, but you could Allreduce if needed
-            std::cout << "Iteration " << it << " residual = " << residual << "\n";
-            prev = current;
-
-            if (it == max_iterations) {
-                std::ofstream out("output_mpi_cpu.ppm");
-                out << "P3\n" << W << " " << H << "\n255\n";
-                for (int j = H-1; j >= 0; --j) {
-                    for (int i = 0; i < W; ++i) {
-                        write_color(out, current[j*W + i],
-                                    state.iterations * state.cfg.spp_per_iteration);
-                    }
-                }
-                std::cout << "Wrote output_mpi_cpu.ppm\n";
+        DenoiseReport denoise;
+        if (opt.denoise) {
+            std::string denoised = denoised_path(path);
+            if (write_denoised_output(state, denoised, opt.reference, denoise)) {
+                std::cout << "Wrote " << denoised << "\n";
+                print_denoise_report(denoise);
             }
         }
 
-        MPI_Barrier(MPI_COMM_WORLD);
-        state.iterations += 1;
+        if (COUNTERS_ENABLED) {
+            std::string json = telemetry_path(path);
+            if (write_telemetry_json(json, state, run_counters, total_seconds, world_size,
+                                     opt.denoise ? &denoise : nullptr))
+                std::cout << "Wrote " << json << "\n";
+            else
+                std::cerr << "Failed to write " << json << "\n";
+        }
+    }
+
+    // Timeline: every rank's events, one process per rank
+    if (!opt.profile.empty()) {
+        std::string events = profile_events_json(world_rank, "rank " + std::to_string(world_rank));
+        int len = static_cast<int>(events.size());
+        std::vector<int> lens(world_size), displs(world_size);
+        MPI_Gather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        std::string all;
+        if (world_rank == 0) {
+            for (int r = 0; r < world_size; ++r)
+                displs[r] = r ? displs[r-1] + lens[r-1] : 0;
+            all.resize(displs[world_size-1] + lens[world_size-1]);
+        }
+        MPI_Gatherv(events.data(), len, MPI_CHAR, &all[0], lens.data(), displs.data(),
+                    MPI_CHAR, 0, MPI_COMM_WORLD);
+        if (world_rank == 0) {
+            // Join the ranks' event lists
+            std::string joined;
+            for (int r = 0; r < world_size; ++r) {
+                if (r) joined += ",\n";
+                joined.append(all, displs[r], lens[r]);
+            }
+            if (write_profile_json(opt.profile, joined))
+                std::cout << "Wrote " << opt.profile << "\n";
+            else
+                std::cerr << "Failed to write " << opt.profile << "\n";
+        }
     }
 
     MPI_Finalize();